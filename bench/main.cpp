@@ -0,0 +1,568 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+/*
+ * Throughput benchmarks. Run from the root directory of the project (the
+ * fibonacci and corpus benchmarks load their programs from ./testmips and
+ * ./benchmips):
+ *
+ *     ./build/release/bench [--counters] [--mix] [name filter]
+ *
+ * --counters adds host hardware counters per guest instruction to the
+ * execution benchmarks, --mix the guest instruction mix of the programs.
+ */
+
+#include "../src/coverage.h"
+#include "../src/cpupool.h"
+#include "../src/disasm.h"
+#include "../src/mipscpu.h"
+#include "perfcounters.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using tememu::int32;
+using tememu::MipsCPU;
+
+namespace
+{
+    typedef boost::shared_ptr< std::vector<int32> > Program;
+
+    const char* name_filter = 0;
+    bool show_mix = false;
+    boost::scoped_ptr<tememu::PerfCounters> counters;
+
+    double now()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    bool selected(const std::string& name)
+    {
+        return !name_filter || name.find(name_filter) != std::string::npos;
+    }
+
+    /**
+     * @brief Starts the clock and the hardware counters of an execution benchmark.
+     */
+    double startExecution()
+    {
+        if (counters) counters->start();
+        return now();
+    }
+
+    void reportExecution(const std::string& name, boost::uint64_t instructions, double seconds)
+    {
+        std::printf("%-28s %10.1f guest MIPS %8.2f ns/instr\n", name.c_str(),
+            instructions / seconds / 1e6, seconds * 1e9 / instructions);
+
+        if (!counters) return;
+        counters->stop();
+
+        std::printf("    per guest instr:");
+        for (int i = 0; i < tememu::PerfCounters::event_count; ++i)
+        {
+            tememu::PerfCounters::Event event = static_cast<tememu::PerfCounters::Event>(i);
+            if (!counters->available(event)) continue;
+            std::printf(" %.3f %s", static_cast<double>(counters->value(event)) / instructions,
+                tememu::PerfCounters::name(event));
+        }
+        std::printf("\n");
+    }
+
+    /**
+     * @brief Prints the most frequent opcodes retired by a CPU with statistics enabled.
+     */
+    void reportMix(const MipsCPU& cpu)
+    {
+        std::vector< std::pair<boost::uint64_t, int> > mix;
+        boost::uint64_t total = 0;
+
+        for (int op = 0; op < tememu::internal_opcode_count; ++op)
+        {
+            boost::uint64_t count = cpu.retiredCount(op);
+            if (count == 0) continue;
+            mix.push_back(std::make_pair(count, op));
+            total += count;
+        }
+
+        std::sort(mix.rbegin(), mix.rend());
+        if (mix.size() > 8) mix.resize(8);
+
+        std::printf("    mix:");
+        for (size_t i = 0; i < mix.size(); ++i)
+        {
+            std::printf(" %s %.1f%%", MipsCPU::opcodeName(mix[i].second), 100.0 * mix[i].first / total);
+        }
+        std::printf("\n");
+    }
+
+    void reportInstances(const std::string& name, boost::uint64_t count, double seconds)
+    {
+        std::printf("%-28s %10.0f instances/sec %8.2f ns/instance\n", name.c_str(),
+            count / seconds, seconds * 1e9 / count);
+    }
+
+    Program loadMipsBinDump(const std::string& fileName)
+    {
+        Program program(new std::vector<int32>);
+        std::ifstream is(fileName.c_str(), std::ios::in | std::ios::binary);
+        int32 x = 0;
+
+        while (is.read((char*)&x, sizeof(x))) program->push_back(x);
+        return program;
+    }
+
+    int32 rtype(int funct, int rd, int rs, int rt)
+    {
+        return (rs << 21) | (rt << 16) | (rd << 11) | funct;
+    }
+
+    int32 special2(int funct, int rd, int rs, int rt)
+    {
+        return (0x1C << 26) | rtype(funct, rd, rs, rt);
+    }
+
+    int32 cop1(int fmt, int funct, int fd, int fs, int ft)
+    {
+        return (0x11 << 26) | (fmt << 21) | (ft << 16) | (fs << 11) | (fd << 6) | funct;
+    }
+
+    int32 cop0(int rs, int rt, int rd)
+    {
+        return (0x10 << 26) | (rs << 21) | (rt << 16) | (rd << 11);
+    }
+
+    int32 itype(int opcode, int rt, int rs, int imm)
+    {
+        return (opcode << 26) | (rs << 21) | (rt << 16) | (imm & 0xFFFF);
+    }
+
+    int32 jtype(int opcode, boost::uint32_t target)
+    {
+        return (opcode << 26) | ((target >> 2) & 0x03FFFFFF);
+    }
+
+    enum { t0 = 8, t1 = 9, t2 = 10 };
+    enum { fmt_s = 0x10, fmt_d = 0x11, fmt_w = 0x14 };
+
+    const int block_length = 1024;
+    const int data_addr = (block_length + 4) * 4 + 256;
+    const int dispatch_instructions = 20 * 1000 * 1000;
+
+    /**
+     * @brief How to build a program that executes one instruction over and over.
+     *
+     * Straight line instructions are repeated block_length times, followed 
+     * by a jump back to the start. Jumps and taken branches jump to 
+     * themselves instead.
+     */
+    struct OpcodeBench
+    {
+        const char* name;
+        int32 instr;
+        bool selfLoop;
+    };
+
+    const OpcodeBench opcode_benches[] = 
+    {
+        { "add",     rtype(0x20, t2, t0, t1), false },
+        { "addu",    rtype(0x21, t2, t0, t1), false },
+        { "sub",     rtype(0x22, t2, t0, t1), false },
+        { "subu",    rtype(0x23, t2, t0, t1), false },
+        { "addi",    itype(0x08, t2, t0, 1), false },
+        { "addiu",   itype(0x09, t2, t0, 1), false },
+        { "mult",    rtype(0x18, 0, t0, t1), false },
+        { "multu",   rtype(0x19, 0, t0, t1), false },
+        { "madd",    special2(0x00, 0, t0, t1), false },
+        { "maddu",   special2(0x01, 0, t0, t1), false },
+        { "msub",    special2(0x04, 0, t0, t1), false },
+        { "msubu",   special2(0x05, 0, t0, t1), false },
+        { "mul",     special2(0x02, t2, t0, t1), false },
+        { "div",     rtype(0x1A, 0, t0, t1), false },
+        { "divu",    rtype(0x1B, 0, t0, t1), false },
+        { "beq",     itype(0x04, t1, t0, 0), false },   // not taken
+        { "bne",     itype(0x05, t0, t0, 0), false },   // not taken
+        { "bne_taken", itype(0x05, t1, t0, -1), true },
+        { "j",       jtype(0x02, 0), true },
+        { "jal",     jtype(0x03, 0), true },
+        { "jr",      rtype(0x08, 0, 0, 0), true },      // jr $zero
+        { "jalr",    rtype(0x09, t2, 0, 0), true },     // jalr $t2, $zero
+        { "mfhi",    rtype(0x10, t2, 0, 0), false },
+        { "mthi",    rtype(0x11, 0, t0, 0), false },
+        { "mflo",    rtype(0x12, t2, 0, 0), false },
+        { "mtlo",    rtype(0x13, 0, t0, 0), false },
+        { "syscall", rtype(0x0C, 0, 0, 0), false },
+        { "lw",      itype(0x23, t2, 0, data_addr), false },
+        { "sw",      itype(0x2B, t0, 0, data_addr), false },
+        { "ll",      itype(0x30, t2, 0, data_addr), false },
+        { "sc",      itype(0x38, t2, 0, data_addr), false },
+        { "sync",    rtype(0x0F, 0, 0, 0), false },
+        { "mfc0",    cop0(0x00, t2, 12), false },       // mfc0 $t2, Status
+        { "mtc0",    cop0(0x04, t0, 14), false },       // mtc0 $t0, EPC
+        { "break",   rtype(0x0D, 0, 0, 0), false },     // each one is delivered to the vector
+        { "and",     rtype(0x24, t2, t0, t1), false },
+        { "andi",    itype(0x0C, t2, t0, 0xFF), false },
+        { "or",      rtype(0x25, t2, t0, t1), false },
+        { "ori",     itype(0x0D, t2, t0, 0xFF), false },
+        { "xor",     rtype(0x26, t2, t0, t1), false },
+        { "nor",     rtype(0x27, t2, t0, t1), false },
+        { "sll",     rtype(0x00, t2, 0, t0) | (3 << 6), false },
+        { "srl",     rtype(0x02, t2, 0, t0) | (3 << 6), false },
+        { "sra",     rtype(0x03, t2, 0, t0) | (3 << 6), false },
+        { "sllv",    rtype(0x04, t2, t1, t0), false },
+        { "srlv",    rtype(0x06, t2, t1, t0), false },
+        { "srav",    rtype(0x07, t2, t1, t0), false },
+        { "slt",     rtype(0x2A, t2, t0, t1), false },
+        { "sltu",    rtype(0x2B, t2, t0, t1), false },
+        { "slti",    itype(0x0A, t2, t0, 5), false },
+        { "sltiu",   itype(0x0B, t2, t0, 5), false },
+        { "mfc1",    cop1(0x00, 0, 0, 0, t2), false },
+        { "mtc1",    cop1(0x04, 0, 0, 4, t0), false },
+        { "cfc1",    cop1(0x02, 0, 0, 31, t2), false },
+        { "ctc1",    cop1(0x06, 0, 0, 31, 0), false },
+        { "bc1t",    itype(0x11, 0x01, 0x08, 0), false }, // not taken
+        { "lwc1",    itype(0x31, 4, 0, data_addr), false },
+        { "swc1",    itype(0x39, 4, 0, data_addr), false },
+        { "add.s",   cop1(fmt_s, 0x00, 4, 0, 2), false },
+        { "sub.s",   cop1(fmt_s, 0x01, 4, 0, 2), false },
+        { "mul.s",   cop1(fmt_s, 0x02, 4, 0, 2), false },
+        { "div.s",   cop1(fmt_s, 0x03, 4, 0, 2), false },
+        { "sqrt.s",  cop1(fmt_s, 0x04, 4, 0, 0), false },
+        { "abs.s",   cop1(fmt_s, 0x05, 4, 0, 0), false },
+        { "mov.s",   cop1(fmt_s, 0x06, 4, 0, 0), false },
+        { "neg.s",   cop1(fmt_s, 0x07, 4, 0, 0), false },
+        { "trunc.w.s", cop1(fmt_s, 0x0D, 4, 0, 0), false },
+        { "cvt.d.s", cop1(fmt_s, 0x21, 12, 0, 0), false },
+        { "cvt.w.s", cop1(fmt_s, 0x24, 4, 0, 0), false },
+        { "c.lt.s",  cop1(fmt_s, 0x3C, 0, 0, 2), false },
+        { "add.d",   cop1(fmt_d, 0x00, 12, 8, 10), false },
+        { "sub.d",   cop1(fmt_d, 0x01, 12, 8, 10), false },
+        { "mul.d",   cop1(fmt_d, 0x02, 12, 8, 10), false },
+        { "div.d",   cop1(fmt_d, 0x03, 12, 8, 10), false },
+        { "sqrt.d",  cop1(fmt_d, 0x04, 12, 8, 0), false },
+        { "abs.d",   cop1(fmt_d, 0x05, 12, 8, 0), false },
+        { "mov.d",   cop1(fmt_d, 0x06, 12, 8, 0), false },
+        { "neg.d",   cop1(fmt_d, 0x07, 12, 8, 0), false },
+        { "trunc.w.d", cop1(fmt_d, 0x0D, 4, 8, 0), false },
+        { "cvt.s.d", cop1(fmt_d, 0x20, 4, 8, 0), false },
+        { "cvt.w.d", cop1(fmt_d, 0x24, 4, 8, 0), false },
+        { "c.lt.d",  cop1(fmt_d, 0x3C, 0, 8, 10), false },
+        { "cvt.s.w", cop1(fmt_w, 0x20, 4, 2, 0), false },
+        { "cvt.d.w", cop1(fmt_w, 0x21, 12, 2, 0), false },
+    };
+
+    // returns at once, so syscall measures the dispatch to the host
+    bool ignoreHostCall(MipsCPU&)
+    {
+        return true;
+    }
+
+    void benchDispatch()
+    {
+        for (size_t i = 0; i < sizeof(opcode_benches) / sizeof(opcode_benches[0]); ++i)
+        {
+            const OpcodeBench& bench = opcode_benches[i];
+            std::string name = std::string("dispatch/") + bench.name;
+            if (!selected(name)) continue;
+
+            Program program(new std::vector<int32>);
+
+            if (bench.selfLoop)
+            {
+                program->push_back(bench.instr);
+                program->push_back(0); // nop, padding for the branch
+            }
+            else
+            {
+                program->assign(block_length, bench.instr);
+                program->push_back(jtype(0x02, 0));
+                program->push_back(0);
+            }
+
+            MipsCPU cpu;
+            cpu.loadProgram(program);
+            cpu.setHostCallHandler(&ignoreHostCall);
+            cpu.setExceptionBase(0); // the vector lands in the block, so break keeps running
+            cpu.setGPR(t0, 7);
+            cpu.setGPR(t1, 3);
+
+            // 7 and 3 as singles in $f0 and $f2, and as doubles in $f8 and $f10
+            cpu.setFPR(0, 0x40e00000);
+            cpu.setFPR(2, 0x40400000);
+            cpu.setFPR(9, 0x401c0000);
+            cpu.setFPR(11, 0x40080000);
+
+            double start = startExecution();
+            int executed = cpu.stepProgram(dispatch_instructions);
+            double seconds = now() - start;
+
+            reportExecution(name, executed, seconds);
+        }
+    }
+
+    void benchFibonacci()
+    {
+        static const int iterations[] = { 1000, 1000 * 1000, 10 * 1000 * 1000 };
+        Program program = loadMipsBinDump("testmips/fibo_2.bin");
+
+        if (program->empty())
+        {
+            std::fprintf(stderr, "testmips/fibo_2.bin not found, run from the project root\n");
+            return;
+        }
+
+        for (size_t i = 0; i < sizeof(iterations) / sizeof(iterations[0]); ++i)
+        {
+            char name[64];
+            std::sprintf(name, "fibonacci/%d", iterations[i]);
+            if (!selected(name)) continue;
+
+            MipsCPU cpu;
+            cpu.loadProgram(program);
+
+            // repeat short runs until the total is significant
+            int repeats = std::max(1, 10 * 1000 * 1000 / iterations[i]);
+            boost::uint64_t executed = 0;
+            double start = startExecution();
+
+            for (int r = 0; r < repeats; ++r)
+            {
+                cpu.reset();
+                cpu.setGPR(7, iterations[i]);
+                while (!cpu.halted()) executed += cpu.stepProgram(1 << 30);
+            }
+
+            reportExecution(name, executed, now() - start);
+
+            if (show_mix)
+            {
+                cpu.enableStatistics(true);
+                cpu.reset();
+                cpu.setGPR(7, iterations[i]);
+                cpu.runProgram();
+                reportMix(cpu);
+            }
+        }
+    }
+
+    struct Expectation
+    {
+        int reg;
+        boost::uint32_t value;
+    };
+
+    /**
+     * @brief Reads the "$reg = value" lines of a .expected file.
+     */
+    std::vector<Expectation> loadExpectations(const std::string& fileName)
+    {
+        std::vector<Expectation> result;
+        std::ifstream is(fileName.c_str());
+        std::string line;
+
+        while (std::getline(is, line))
+        {
+            std::istringstream fields(line);
+            std::string name, equals;
+            Expectation e;
+
+            if (!(fields >> name >> equals >> std::hex >> e.value) || equals != "=") continue;
+            for (e.reg = 0; e.reg < tememu::gpr_count && tememu::registerName(e.reg) != name; ++e.reg);
+            if (e.reg < tememu::gpr_count) result.push_back(e);
+        }
+        return result;
+    }
+
+    /**
+     * @brief Guest kernels resembling real workloads, sources in ./benchmips.
+     *
+     * Every run is checked against the expected register values, so a
+     * fast but wrong emulator does not go unnoticed.
+     */
+    const char* corpus_kernels[] = { "intmix", "memcopy", "calls", "switch", "divide" };
+    const size_t corpus_size = sizeof(corpus_kernels) / sizeof(corpus_kernels[0]);
+
+    /**
+     * @brief Runs the corpus, with edge coverage collection if prefix is "coverage/".
+     */
+    void benchCorpus(const std::string& prefix)
+    {
+        boost::shared_ptr<tememu::CoverageMap> coverage;
+        if (prefix == "coverage/") coverage.reset(new tememu::CoverageMap);
+
+        for (size_t i = 0; i < corpus_size; ++i)
+        {
+            std::string name = prefix + corpus_kernels[i];
+            if (!selected(name)) continue;
+
+            std::string base = std::string("benchmips/") + corpus_kernels[i];
+            Program program = loadMipsBinDump(base + ".bin");
+            std::vector<Expectation> expected = loadExpectations(base + ".expected");
+
+            if (program->empty() || expected.empty())
+            {
+                std::fprintf(stderr, "%s.bin or .expected not found, run from the project root\n", base.c_str());
+                continue;
+            }
+
+            MipsCPU cpu;
+            cpu.loadProgram(program);
+            cpu.attachCoverage(coverage);
+
+            boost::uint64_t executed = 0;
+            bool correct = true;
+            double start = startExecution();
+
+            // the kernels initialize the memory they read, resetting the registers is enough
+            while (executed < 20 * 1000 * 1000)
+            {
+                cpu.reset();
+                while (!cpu.halted()) executed += cpu.stepProgram(1 << 30);
+
+                for (size_t e = 0; e < expected.size(); ++e)
+                    correct &= static_cast<boost::uint32_t>(cpu.gprValue(expected[e].reg)) == expected[e].value;
+            }
+
+            double seconds = now() - start;
+            if (correct) reportExecution(name, executed, seconds);
+            else std::printf("%-28s WRONG RESULT\n", name.c_str());
+
+            if (show_mix)
+            {
+                cpu.enableStatistics(true);
+                cpu.reset();
+                cpu.runProgram();
+                reportMix(cpu);
+            }
+        }
+    }
+
+    void benchCoverageMerge()
+    {
+        if (!selected("coverage/merge")) return;
+
+        tememu::CoverageMap total, run;
+        const int merges = 100 * 1000;
+
+        for (size_t i = 0; i < tememu::CoverageMap::map_size; i += 7) run.data()[i] = 1;
+
+        double start = now();
+        for (int i = 0; i < merges; ++i) total.merge(run);
+        reportInstances("coverage/merge", merges, now() - start);
+    }
+
+    void benchConstruction()
+    {
+        const int count = 1000 * 1000;
+        const int population = 100 * 1000;
+
+        // a whole population is created, then destroyed, like a host spawning guests
+        if (selected("construct/new"))
+        {
+            std::vector<MipsCPU*> cpus(population);
+            double start = now();
+
+            for (int round = 0; round < count / population; ++round)
+            {
+                for (int i = 0; i < population; ++i) cpus[i] = new MipsCPU;
+                for (int i = 0; i < population; ++i) delete cpus[i];
+            }
+
+            reportInstances("construct/new", count, now() - start);
+        }
+
+        if (selected("construct/pool"))
+        {
+            tememu::CpuPool pool;
+            std::vector<MipsCPU*> cpus(population);
+            double start = now();
+
+            for (int round = 0; round < count / population; ++round)
+            {
+                for (int i = 0; i < population; ++i) cpus[i] = pool.construct();
+                for (int i = 0; i < population; ++i) pool.destroy(cpus[i]);
+            }
+
+            reportInstances("construct/pool", count, now() - start);
+        }
+
+        if (selected("reset"))
+        {
+            MipsCPU cpu;
+            double start = now();
+            for (int i = 0; i < count; ++i) cpu.reset();
+            reportInstances("reset", count, now() - start);
+        }
+
+        if (selected("loadProgram"))
+        {
+            Program program = loadMipsBinDump("testmips/fibo_2.bin");
+            MipsCPU cpu;
+            const int loads = count / 10;
+
+            double start = now();
+            for (int i = 0; i < loads; ++i) cpu.loadProgram(program);
+            reportInstances("loadProgram", loads, now() - start);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--counters") == 0) counters.reset(new tememu::PerfCounters);
+        else if (std::strcmp(argv[i], "--mix") == 0) show_mix = true;
+        else name_filter = argv[i];
+    }
+
+    if (counters && !counters->available())
+    {
+        std::fprintf(stderr, "no hardware counters available (perf_event_open failed)\n");
+        counters.reset();
+    }
+
+    benchDispatch();
+    benchFibonacci();
+    benchCorpus("corpus/");
+    benchCorpus("coverage/");
+    benchCoverageMerge();
+    benchConstruction();
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "perfcounters.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace tememu
+{
+    namespace
+    {
+        struct EventConfig
+        {
+            const char* name;
+            boost::uint32_t type;
+            boost::uint64_t config;
+        };
+
+        boost::uint64_t cacheMiss(boost::uint64_t cache)
+        {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+
+        // in the order of PerfCounters::Event
+        const EventConfig events[] =
+        {
+            { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { "L1i-misses",    PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1I) },
+            { "L1d-misses",    PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D) },
+            { "iTLB-misses",   PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_ITLB) },
+        };
+
+        int openCounter(const EventConfig& event)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = event.type;
+            attr.config = event.config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            // this thread, any CPU, no group
+            return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+    }
+
+    PerfCounters::PerfCounters()
+    {
+        for (int i = 0; i < event_count; ++i)
+        {
+            _fds[i] = openCounter(events[i]);
+            _values[i] = 0;
+        }
+    }
+
+    PerfCounters::~PerfCounters()
+    {
+        for (int i = 0; i < event_count; ++i)
+        {
+            if (_fds[i] >= 0) close(_fds[i]);
+        }
+    }
+
+    bool PerfCounters::available() const
+    {
+        for (int i = 0; i < event_count; ++i)
+        {
+            if (_fds[i] >= 0) return true;
+        }
+        return false;
+    }
+
+    void PerfCounters::start()
+    {
+        for (int i = 0; i < event_count; ++i)
+        {
+            if (_fds[i] < 0) continue;
+            ioctl(_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void PerfCounters::stop()
+    {
+        for (int i = 0; i < event_count; ++i)
+        {
+            _values[i] = 0;
+            if (_fds[i] < 0) continue;
+            ioctl(_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            // value, time enabled, time running
+            boost::uint64_t data[3];
+            if (read(_fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) continue;
+
+            _values[i] = data[2] < data[1]
+                ? static_cast<boost::uint64_t>(static_cast<double>(data[0]) * data[1] / data[2])
+                : data[0];
+        }
+    }
+
+    const char* PerfCounters::name(Event event)
+    {
+        return events[event].name;
+    }
+
+} // tememu
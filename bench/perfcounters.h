@@ -0,0 +1,78 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _PERFCOUNTERS_H
+#define _PERFCOUNTERS_H
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace tememu
+{
+    /**
+     * @brief Host hardware counters of the calling thread, read through perf_event_open.
+     *
+     * Counters the kernel or the CPU does not support (virtual machines often
+     * have none) are left closed, see available(). Only user space is counted.
+     */
+    class PerfCounters : boost::noncopyable
+    {
+    public:
+        enum Event
+        {
+            cycles,
+            instructions,
+            branch_misses,
+            l1i_misses,
+            l1d_misses,
+            itlb_misses,
+            event_count
+        };
+
+        PerfCounters();
+        ~PerfCounters();
+
+        bool available() const;
+        bool available(Event event) const { return _fds[event] >= 0; }
+
+        // resets and enables every open counter
+        void start();
+        // disables the counters and latches their values
+        void stop();
+
+        /**
+         * @brief The value latched by stop(), scaled up if the kernel had
+         * to multiplex the counter.
+         */
+        boost::uint64_t value(Event event) const { return _values[event]; }
+        static const char* name(Event event);
+
+    private:
+        int _fds[event_count];
+        boost::uint64_t _values[event_count];
+    };
+
+} // tememu
+
+#endif //include guard
@@ -0,0 +1,38 @@
+# calls: function call heavy code.
+#
+# Naive recursive fibonacci(18) with the usual stack frames.
+# Result: $v0 = fib(18).
+
+main:   ori   $sp, $zero, 0x3ff0
+        addi  $a0, $zero, 18
+        jal   fib
+        nop
+        j     end
+        nop
+
+fib:    addi  $sp, $sp, -12
+        sw    $ra, 0($sp)
+        sw    $s0, 4($sp)
+        sw    $s1, 8($sp)
+        add   $s0, $a0, $zero
+        add   $v0, $a0, $zero       # fib(0) = 0, fib(1) = 1
+        beq   $s0, $zero, ret
+        nop
+        addi  $t0, $s0, -1
+        beq   $t0, $zero, ret
+        nop
+        addi  $a0, $s0, -1
+        jal   fib
+        nop
+        add   $s1, $v0, $zero
+        addi  $a0, $s0, -2
+        jal   fib
+        nop
+        addu  $v0, $v0, $s1
+ret:    lw    $ra, 0($sp)
+        lw    $s0, 4($sp)
+        lw    $s1, 8($sp)
+        addi  $sp, $sp, 12
+        jr    $ra
+        nop
+end:
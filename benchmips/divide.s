@@ -0,0 +1,25 @@
+# divide: division heavy code.
+#
+# Sums the decimal digits of 1..4999 (one divu by 10 per digit) and
+# i mod 7 for the same numbers.
+# Result: $v0 = digit sum, $v1 = sum of the remainders.
+
+        addi  $s0, $zero, 1         # i
+        ori   $s1, $zero, 5000
+        addi  $s2, $zero, 10
+        addi  $s3, $zero, 7
+        addu  $v0, $zero, $zero
+        addu  $v1, $zero, $zero
+outer:  add   $t0, $s0, $zero
+digit:  divu  $t0, $s2
+        mfhi  $t1
+        mflo  $t0
+        addu  $v0, $v0, $t1
+        bne   $t0, $zero, digit
+        nop
+        div   $s0, $s3
+        mfhi  $t2
+        addu  $v1, $v1, $t2
+        addi  $s0, $s0, 1
+        bne   $s0, $s1, outer
+        nop
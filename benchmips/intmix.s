@@ -0,0 +1,22 @@
+# intmix: Dhrystone style integer mix.
+#
+# 20000 rounds of add/sub/logic/multiply on a few live values.
+# Result: $v0 and $v1 hold the final accumulator values.
+
+        ori   $s0, $zero, 20000     # rounds
+        addi  $v0, $zero, 1         # accumulator
+        addi  $v1, $zero, 7
+        addi  $t3, $zero, 100
+loop:   addu  $t0, $v0, $v1
+        xor   $t1, $t0, $s0
+        andi  $t2, $t1, 0xff
+        mult  $t2, $t3              # at most 255 * 100
+        mflo  $t4
+        subu  $t5, $t4, $t0
+        or    $t6, $t5, $v1
+        nor   $t7, $t6, $zero
+        addu  $v0, $t7, $t1
+        andi  $v1, $v0, 0x3ff
+        addi  $s0, $s0, -1
+        bne   $s0, $zero, loop
+        nop
@@ -0,0 +1,37 @@
+# memcopy: memory heavy loop.
+#
+# Fills a 1024 word array, then 20 times copies it to a second array
+# (xor-ing each word with the round number) and swaps the two.
+# Result: $v0 holds the sum of every word stored by the copy loops.
+
+        ori   $s1, $zero, 0x1000    # source array
+        ori   $s2, $zero, 0x2000    # destination array
+        addi  $t0, $zero, 1024
+        add   $t1, $s1, $zero
+        addi  $t2, $zero, 1
+init:   sw    $t2, 0($t1)
+        addi  $t2, $t2, 3
+        addi  $t1, $t1, 4
+        addi  $t0, $t0, -1
+        bne   $t0, $zero, init
+        nop
+        addi  $s3, $zero, 20        # rounds
+        addu  $v0, $zero, $zero
+round:  addi  $t0, $zero, 1024
+        add   $t1, $s1, $zero
+        add   $t3, $s2, $zero
+copy:   lw    $t4, 0($t1)
+        xor   $t4, $t4, $s3
+        sw    $t4, 0($t3)
+        addu  $v0, $v0, $t4
+        addi  $t1, $t1, 4
+        addi  $t3, $t3, 4
+        addi  $t0, $t0, -1
+        bne   $t0, $zero, copy
+        nop
+        add   $t5, $s1, $zero       # swap the arrays
+        add   $s1, $s2, $zero
+        add   $s2, $t5, $zero
+        addi  $s3, $s3, -1
+        bne   $s3, $zero, round
+        nop
@@ -0,0 +1,55 @@
+# switch: switch statement compiled to a jump table.
+#
+# 20000 rounds of an 8-way switch on the low bits of a state that
+# depends on the previous case.
+# Result: $v0 is the accumulator, $s1 the final state.
+
+        ori   $s0, $zero, 20000     # rounds
+        addu  $v0, $zero, $zero
+        addi  $s1, $zero, 3         # state
+loop:   andi  $t0, $s1, 7
+        add   $t0, $t0, $t0
+        add   $t0, $t0, $t0
+        lw    $t1, table($t0)
+        jr    $t1
+        nop
+case0:  addi  $v0, $v0, 1
+        j     next
+        nop
+case1:  xor   $v0, $v0, $s0
+        j     next
+        nop
+case2:  addu  $v0, $v0, $s1
+        j     next
+        nop
+case3:  subu  $v0, $v0, $s0
+        j     next
+        nop
+case4:  nor   $v0, $v0, $s1
+        j     next
+        nop
+case5:  addi  $v0, $v0, -7
+        j     next
+        nop
+case6:  or    $v0, $v0, $s0
+        j     next
+        nop
+case7:  andi  $v0, $v0, 0x7fff
+        j     next
+        nop
+next:   addu  $s1, $s1, $v0
+        addi  $s1, $s1, 5
+        addi  $s0, $s0, -1
+        bne   $s0, $zero, loop
+        nop
+        j     end
+        nop
+table:  .word case0
+        .word case1
+        .word case2
+        .word case3
+        .word case4
+        .word case5
+        .word case6
+        .word case7
+end:
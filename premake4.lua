@@ -17,7 +17,19 @@ solution "tememu"
     project "test"
         kind     "ConsoleApp"
         files    { "./src/**.h", "./src/**.cpp", "./test/main.cpp" }
-        links { "gtest", "gtest_main", "pthread" }
+        links { "gtest", "gtest_main", "boost_thread", "boost_system", "pthread" }
+
+        configuration { "debug" }
+            flags   { "Symbols" }
+
+        configuration { "release" }
+            defines { "NDEBUG", "RELEASE" }
+            flags   { "Optimize" }
+
+    project "bench"
+        kind     "ConsoleApp"
+        files    { "./src/**.h", "./src/**.cpp", "./bench/**.cpp" }
+        links { "boost_thread", "boost_system", "pthread" }
 
         configuration { "debug" }
             flags   { "Symbols" }
@@ -36,4 +48,15 @@ solution "tememu"
         configuration { "release" }
             defines { "NDEBUG", "RELEASE" }
             flags   { "Optimize" }
-        
+
+    project "tracedump"
+        kind     "ConsoleApp"
+        files    { "./src/**.h", "./src/**.cpp", "./tools/tracedump.cpp" }
+        links { "boost_thread", "boost_system", "pthread" }
+
+        configuration { "debug" }
+            flags   { "Symbols" }
+
+        configuration { "release" }
+            defines { "NDEBUG", "RELEASE" }
+            flags   { "Optimize" }
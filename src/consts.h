@@ -31,6 +31,18 @@ namespace tememu
     const int fpr_count = 32;
     const int fcr_count = 5;
 
+    // primary opcodes take 0..63, SPECIAL (opcode 0) functions 64..127,
+    // SPECIAL2 (opcode 0x1C) functions 128..191; COP1 (opcode 0x11) moves
+    // and branches by rs 192..223, S, D and W format functions 224..415
+    const int internal_opcode_count = 416;
+
+    // bytes of data memory placed after the program text by MipsCPU::loadProgram
+    const int default_data_size = 16 * 1024;
+
+    // instructions executed between two checks of the pending event word;
+    // bounds the latency of requestStop and raiseInterrupt
+    const int event_poll_interval = 1024;
+
 } // tememu
 
 #endif
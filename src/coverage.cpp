@@ -0,0 +1,142 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "coverage.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <cstring>
+#include <stdexcept>
+
+namespace tememu
+{
+    const size_t CoverageMap::map_size;
+
+    /**
+     * @brief Creates a map in an anonymous shared mapping.
+     */
+    CoverageMap::CoverageMap()
+        : _bits(0)
+    {
+        map(-1);
+    }
+
+    /**
+     * @brief Maps path, creating it if needed. An existing map is kept, 
+     * so several processes can attach to the same file.
+     */
+    CoverageMap::CoverageMap(const std::string& path)
+        : _bits(0)
+    {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) throw std::runtime_error("CoverageMap: cannot open " + path);
+
+        try
+        {
+            map(fd);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+
+        ::close(fd);
+    }
+
+    CoverageMap::~CoverageMap()
+    {
+        if (_bits) munmap(_bits, map_size);
+    }
+
+    void CoverageMap::map(int fd)
+    {
+        if (fd >= 0 && ftruncate(fd, map_size) != 0)
+            throw std::runtime_error("CoverageMap: cannot resize the map file");
+
+        void* mapping = fd >= 0
+            ? mmap(0, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+            : mmap(0, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) throw std::runtime_error("CoverageMap: mmap failed");
+
+        _bits = static_cast<boost::uint8_t*>(mapping);
+    }
+
+    void CoverageMap::clear()
+    {
+        std::memset(_bits, 0, map_size);
+    }
+
+    /**
+     * @brief The number of distinct edge slots hit.
+     */
+    size_t CoverageMap::edgeCount() const
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < map_size; ++i) count += _bits[i] != 0;
+        return count;
+    }
+
+    /**
+     * @brief Merges two raw maps of map_size bytes, 16 bytes at a time with SSE2.
+     */
+    size_t CoverageMap::merge(boost::uint8_t* into, const boost::uint8_t* from)
+    {
+        size_t added = 0;
+
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+
+        for (size_t i = 0; i < map_size; i += 16)
+        {
+            __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(into + i));
+            __m128i run = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i));
+
+            // lanes that were empty and are hit by the run
+            int wasEmpty = _mm_movemask_epi8(_mm_cmpeq_epi8(old, zero));
+            int isEmpty = _mm_movemask_epi8(_mm_cmpeq_epi8(run, zero));
+            int fresh = wasEmpty & ~isEmpty & 0xFFFF;
+            if (fresh) added += __builtin_popcount(fresh);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(into + i), _mm_adds_epu8(old, run));
+        }
+#else
+        for (size_t i = 0; i < map_size; ++i)
+        {
+            if (!from[i]) continue;
+            if (!into[i]) ++added;
+            into[i] = into[i] > 255 - from[i] ? 255 : into[i] + from[i];
+        }
+#endif
+
+        return added;
+    }
+
+} // tememu
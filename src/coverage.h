@@ -0,0 +1,87 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _COVERAGE_H
+#define _COVERAGE_H
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <string>
+
+namespace tememu
+{
+    /**
+     * @brief AFL style edge coverage bitmap.
+     *
+     * Every block transition bumps the byte indexed by a hash of the 
+     * previous and the current block address. The map lives in shared 
+     * memory: either an anonymous shared mapping, inherited by forked 
+     * children, or a file (e.g. in /dev/shm) that a fuzzer maps as well.
+     *
+     * Cores may share a map; like in AFL the byte increments are not 
+     * atomic, so concurrent hits of the same edge may be lost.
+     */
+    class CoverageMap : boost::noncopyable
+    {
+    public:
+        static const size_t map_size = 1 << 16;
+
+        CoverageMap();
+        explicit CoverageMap(const std::string& path);
+        ~CoverageMap();
+
+        void edge(boost::uint32_t from, boost::uint32_t to)
+        {
+            ++_bits[(location(to) ^ (location(from) >> 1)) & (map_size - 1)];
+        }
+
+        const boost::uint8_t* data() const { return _bits; }
+        boost::uint8_t* data() { return _bits; }
+        void clear();
+        size_t edgeCount() const;
+
+        /**
+         * @brief Adds the hit counts of a run to this map (saturating at 255).
+         *
+         * @return The number of edges the run covered that this map had not.
+         */
+        size_t merge(const CoverageMap& run) { return merge(_bits, run._bits); }
+        static size_t merge(boost::uint8_t* into, const boost::uint8_t* from);
+
+    private:
+        static boost::uint32_t location(boost::uint32_t pc)
+        {
+            return ((pc >> 2) * 0x9E3779B1u) >> 16;
+        }
+
+        void map(int fd);
+
+    private:
+        boost::uint8_t* _bits;
+    };
+
+} // tememu
+
+#endif //include guard
@@ -0,0 +1,113 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "cpupool.h"
+
+#include <boost/bind.hpp>
+
+#include <new>
+
+namespace tememu 
+{
+    CpuPool::CpuPool(size_t slabSize)
+        : _slabSize(slabSize), _free(0)
+    {
+    }
+
+    CpuPool::~CpuPool()
+    {
+        for (size_t i = 0; i < _slabs.size(); ++i)
+            delete[] _slabs[i];
+    }
+
+    MipsCPU* CpuPool::construct()
+    {
+        Slot* slot;
+
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+
+            if (!_free) grow();
+            slot = _free;
+            _free = slot->next;
+        }
+
+        try
+        {
+            return new (slot->storage) MipsCPU;
+        }
+        catch (...)
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            slot->next = _free;
+            _free = slot;
+            throw;
+        }
+    }
+
+    void CpuPool::destroy(MipsCPU* cpu)
+    {
+        if (!cpu) return;
+
+        cpu->~MipsCPU();
+
+        Slot* slot = reinterpret_cast<Slot*>(cpu);
+        boost::mutex::scoped_lock lock(_mutex);
+        slot->next = _free;
+        _free = slot;
+    }
+
+    /**
+     * @brief Constructs an instance that goes back to the pool when the 
+     * last reference is gone.
+     */
+    boost::shared_ptr<MipsCPU> CpuPool::create()
+    {
+        return boost::shared_ptr<MipsCPU>(construct(), boost::bind(&CpuPool::destroy, this, _1));
+    }
+
+    /**
+     * @brief The number of instances the allocated slabs can hold.
+     */
+    size_t CpuPool::capacity() const
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _slabs.size() * _slabSize;
+    }
+
+    void CpuPool::grow()
+    {
+        _slabs.reserve(_slabs.size() + 1);
+
+        Slot* slab = new Slot[_slabSize];
+        _slabs.push_back(slab);
+
+        for (size_t i = 0; i < _slabSize; ++i)
+        {
+            slab[i].next = _free;
+            _free = &slab[i];
+        }
+    }
+
+} // tememu
@@ -0,0 +1,78 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _CPUPOOL_H
+#define _CPUPOOL_H
+
+#include "mipscpu.h"
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+namespace tememu 
+{
+    /**
+     * @brief Slab allocator for large numbers of MipsCPU instances.
+     *
+     * Storage is taken from the heap one slab (slabSize instances) at a time
+     * and destroyed instances are recycled through a free list, so creating
+     * a million CPUs costs a few thousand allocations instead of a million.
+     * The pool must outlive every instance created from it.
+     */
+    class CpuPool : boost::noncopyable
+    {
+    public:
+        explicit CpuPool(size_t slabSize = 1024);
+        ~CpuPool();
+
+        MipsCPU* construct();
+        void destroy(MipsCPU* cpu);
+        boost::shared_ptr<MipsCPU> create();
+
+        size_t capacity() const;
+
+    private:
+        union Slot
+        {
+            Slot* next;
+            char storage[sizeof(MipsCPU)];
+            double align1;  // MipsCPU holds nothing wider than these
+            void* align2;
+        };
+
+        void grow();
+
+    private:
+        const size_t _slabSize;
+        std::vector<Slot*> _slabs;
+        Slot* _free;
+        mutable boost::mutex _mutex;
+    };
+
+} // tememu
+
+#endif //include guard
@@ -0,0 +1,240 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "disasm.h"
+#include "mipscpu.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+namespace tememu 
+{
+    namespace
+    {
+        const char* const reg_names[] = 
+        {
+            "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+            "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+            "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+            "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+        };
+
+        std::string format(const char* fmt, ...)
+        {
+            char buffer[128];
+            va_list args;
+
+            va_start(args, fmt);
+            vsnprintf(buffer, sizeof(buffer), fmt, args);
+            va_end(args);
+
+            return buffer;
+        }
+
+        std::string reg(int index) { return registerName(index); }
+        std::string freg(int index) { return format("$f%d", index & 31); }
+
+        const char* const fpu_conditions[] = 
+        {
+            "f", "un", "eq", "ueq", "olt", "ult", "ole", "ule",
+            "sf", "ngle", "seq", "ngl", "lt", "nge", "le", "ngt"
+        };
+
+        std::string cop1(boost::int32_t instr, boost::uint32_t branchTarget)
+        {
+            const char* op = 0;
+            const char* fmt = 0;
+            int fd = FPR_D(instr), fs = FPR_S(instr), ft = FPR_T(instr);
+
+            switch (FMT(instr))
+            {
+            case 0x00: return "mfc1 " + reg(RT(instr)) + ", " + freg(fs);
+            case 0x02: return "cfc1 " + reg(RT(instr)) + format(", $%d", fs);
+            case 0x04: return "mtc1 " + reg(RT(instr)) + ", " + freg(fs);
+            case 0x06: return "ctc1 " + reg(RT(instr)) + format(", $%d", fs);
+            case 0x08: return format("%s 0x%x", instr & 0x10000 ? "bc1t" : "bc1f", branchTarget);
+            case 0x10: fmt = "s"; break;
+            case 0x11: fmt = "d"; break;
+            case 0x14: fmt = "w"; break;
+            default: return "";
+            }
+
+            if (FUNCT(instr) >= 0x30) 
+                return format("c.%s.%s ", fpu_conditions[FUNCT(instr) & 15], fmt) + freg(fs) + ", " + freg(ft);
+
+            switch (FUNCT(instr))
+            {
+            case 0x00: op = "add"; break;
+            case 0x01: op = "sub"; break;
+            case 0x02: op = "mul"; break;
+            case 0x03: op = "div"; break;
+            case 0x04: return format("sqrt.%s ", fmt) + freg(fd) + ", " + freg(fs);
+            case 0x05: return format("abs.%s ", fmt) + freg(fd) + ", " + freg(fs);
+            case 0x06: return format("mov.%s ", fmt) + freg(fd) + ", " + freg(fs);
+            case 0x07: return format("neg.%s ", fmt) + freg(fd) + ", " + freg(fs);
+            case 0x0D: return format("trunc.w.%s ", fmt) + freg(fd) + ", " + freg(fs);
+            case 0x20: return format("cvt.s.%s ", fmt) + freg(fd) + ", " + freg(fs);
+            case 0x21: return format("cvt.d.%s ", fmt) + freg(fd) + ", " + freg(fs);
+            case 0x24: return format("cvt.w.%s ", fmt) + freg(fd) + ", " + freg(fs);
+            default: return "";
+            }
+            return format("%s.%s ", op, fmt) + freg(fd) + ", " + freg(fs) + ", " + freg(ft);
+        }
+
+        int simm(boost::int32_t instr) { return static_cast<short>(IMMEDIATE(instr)); }
+    }
+
+    std::string registerName(int index)
+    {
+        return std::string("$") + reg_names[index & 31];
+    }
+
+    /**
+     * @brief Renders one instruction in the usual assembler syntax.
+     *
+     * @param pc The address of the instruction, used for branch targets.
+     */
+    std::string disassemble(boost::int32_t instr, boost::uint32_t pc)
+    {
+        if (instr == 0) return "nop";
+
+        const char* rtype = 0;
+        int rs = RS(instr), rt = RT(instr);
+        boost::uint32_t branchTarget = pc + 4 + simm(instr) * 4;
+        boost::uint32_t jumpTarget = ((pc + 4) & 0xf0000000) | ADDRESS(instr);
+
+        switch (OPCODE(instr))
+        {
+        case 0x00:
+            switch (FUNCT(instr))
+            {
+            case 0x00: return "sll " + reg(RD(instr)) + ", " + reg(rt) + format(", %d", SHAMT(instr));
+            case 0x02: return "srl " + reg(RD(instr)) + ", " + reg(rt) + format(", %d", SHAMT(instr));
+            case 0x03: return "sra " + reg(RD(instr)) + ", " + reg(rt) + format(", %d", SHAMT(instr));
+            case 0x04: return "sllv " + reg(RD(instr)) + ", " + reg(rt) + ", " + reg(rs);
+            case 0x06: return "srlv " + reg(RD(instr)) + ", " + reg(rt) + ", " + reg(rs);
+            case 0x07: return "srav " + reg(RD(instr)) + ", " + reg(rt) + ", " + reg(rs);
+            case 0x08: return "jr " + reg(rs);
+            case 0x09: return "jalr " + (RD(instr) == 31 ? reg(rs) : reg(RD(instr)) + ", " + reg(rs));
+            case 0x0C: return "syscall";
+            case 0x0D: return "break";
+            case 0x0F: return "sync";
+            case 0x10: return "mfhi " + reg(RD(instr));
+            case 0x11: return "mthi " + reg(rs);
+            case 0x12: return "mflo " + reg(RD(instr));
+            case 0x13: return "mtlo " + reg(rs);
+            case 0x18: return "mult " + reg(rs) + ", " + reg(rt);
+            case 0x19: return "multu " + reg(rs) + ", " + reg(rt);
+            case 0x1A: return "div " + reg(rs) + ", " + reg(rt);
+            case 0x1B: return "divu " + reg(rs) + ", " + reg(rt);
+            case 0x20: rtype = "add"; break;
+            case 0x21: rtype = "addu"; break;
+            case 0x22: rtype = "sub"; break;
+            case 0x23: rtype = "subu"; break;
+            case 0x24: rtype = "and"; break;
+            case 0x25: rtype = "or"; break;
+            case 0x26: rtype = "xor"; break;
+            case 0x27: rtype = "nor"; break;
+            case 0x2A: rtype = "slt"; break;
+            case 0x2B: rtype = "sltu"; break;
+            }
+            if (rtype) return std::string(rtype) + " " + reg(RD(instr)) + ", " + reg(rs) + ", " + reg(rt);
+            break;
+        case 0x1C:
+            switch (FUNCT(instr))
+            {
+            case 0x00: return "madd " + reg(rs) + ", " + reg(rt);
+            case 0x01: return "maddu " + reg(rs) + ", " + reg(rt);
+            case 0x02: return "mul " + reg(RD(instr)) + ", " + reg(rs) + ", " + reg(rt);
+            case 0x04: return "msub " + reg(rs) + ", " + reg(rt);
+            case 0x05: return "msubu " + reg(rs) + ", " + reg(rt);
+            }
+            break;
+        case 0x10:
+            if (RS(instr) == 0x00) return "mfc0 " + reg(rt) + format(", $%d", RD(instr));
+            if (RS(instr) == 0x04) return "mtc0 " + reg(rt) + format(", $%d", RD(instr));
+            if (instr == 0x42000018) return "eret";
+            break;
+        case 0x11:
+            {
+                std::string text = cop1(instr, branchTarget);
+                if (!text.empty()) return text;
+            }
+            break;
+        case 0x02: return format("j 0x%x", jumpTarget);
+        case 0x03: return format("jal 0x%x", jumpTarget);
+        case 0x04: return "beq " + reg(rs) + ", " + reg(rt) + format(", 0x%x", branchTarget);
+        case 0x05: return "bne " + reg(rs) + ", " + reg(rt) + format(", 0x%x", branchTarget);
+        case 0x08: return "addi " + reg(rt) + ", " + reg(rs) + format(", %d", simm(instr));
+        case 0x09: return "addiu " + reg(rt) + ", " + reg(rs) + format(", %d", simm(instr));
+        case 0x0A: return "slti " + reg(rt) + ", " + reg(rs) + format(", %d", simm(instr));
+        case 0x0B: return "sltiu " + reg(rt) + ", " + reg(rs) + format(", %d", simm(instr));
+        case 0x0C: return "andi " + reg(rt) + ", " + reg(rs) + format(", 0x%x", IMMEDIATE(instr));
+        case 0x0D: return "ori " + reg(rt) + ", " + reg(rs) + format(", 0x%x", IMMEDIATE(instr));
+        case 0x23: return "lw " + reg(rt) + format(", %d(", simm(instr)) + reg(rs) + ")";
+        case 0x2B: return "sw " + reg(rt) + format(", %d(", simm(instr)) + reg(rs) + ")";
+        case 0x30: return "ll " + reg(rt) + format(", %d(", simm(instr)) + reg(rs) + ")";
+        case 0x38: return "sc " + reg(rt) + format(", %d(", simm(instr)) + reg(rs) + ")";
+        case 0x31: return "lwc1 " + freg(rt) + format(", %d(", simm(instr)) + reg(rs) + ")";
+        case 0x39: return "swc1 " + freg(rt) + format(", %d(", simm(instr)) + reg(rs) + ")";
+        }
+
+        return format(".word 0x%08x", boost::uint32_t(instr));
+    }
+
+    /**
+     * @brief The general purpose register the instruction writes, or no_register.
+     */
+    int writtenRegister(boost::int32_t instr)
+    {
+        switch (OPCODE(instr))
+        {
+        case 0x00:
+            switch (FUNCT(instr))
+            {
+            case 0x00: case 0x02: case 0x03: case 0x04: case 0x06: case 0x07:
+            case 0x09: case 0x10: case 0x12:
+            case 0x20: case 0x21: case 0x22: case 0x23:
+            case 0x24: case 0x25: case 0x26: case 0x27:
+            case 0x2A: case 0x2B:
+                return RD(instr);
+            }
+            return no_register;
+        case 0x1C:
+            return FUNCT(instr) == 0x02 ? RD(instr) : no_register;
+        case 0x10: // mfc0
+            return RS(instr) == 0x00 ? RT(instr) : no_register;
+        case 0x11: // mfc1, cfc1
+            return FMT(instr) == 0x00 || FMT(instr) == 0x02 ? RT(instr) : no_register;
+        case 0x03: 
+            return 31;
+        case 0x08: case 0x09: case 0x0A: case 0x0B: case 0x0C: case 0x0D:
+        case 0x23: case 0x30: case 0x38:
+            return RT(instr);
+        }
+
+        return no_register;
+    }
+
+} // tememu
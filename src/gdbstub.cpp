@@ -0,0 +1,498 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "gdbstub.h"
+#include "mipscpu.h"
+
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace tememu
+{
+    const int GdbStub::continue_slice;
+
+    namespace
+    {
+        // gdb's mips register numbers
+        enum 
+        { 
+            reg_sr = 32, reg_lo, reg_hi, reg_bad, reg_cause, reg_pc, 
+            reg_f0, reg_fsr = reg_f0 + 32, reg_fir, reg_count 
+        };
+
+        enum { signal_int = 2, signal_trap = 5 };
+
+        const char hexDigits[] = "0123456789abcdef";
+
+        void appendHex(std::string& out, boost::uint32_t value, int bytes)
+        {
+            for (int shift = bytes * 8 - 4; shift >= 0; shift -= 4)
+                out += hexDigits[(value >> shift) & 0xF];
+        }
+
+        int hexValue(char c)
+        {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
+
+        // parses hex digits from pos up to a character that is not one
+        bool parseHex(const std::string& s, size_t& pos, boost::uint32_t& value)
+        {
+            size_t start = pos;
+            value = 0;
+            for (; pos < s.size() && hexValue(s[pos]) >= 0; ++pos) value = (value << 4) | hexValue(s[pos]);
+            return pos > start;
+        }
+
+        // "addr,length" with an optional separator after it
+        bool parseRange(const std::string& s, size_t& pos, boost::uint32_t& addr, boost::uint32_t& length)
+        {
+            if (!parseHex(s, pos, addr) || pos >= s.size() || s[pos] != ',') return false;
+            ++pos;
+            return parseHex(s, pos, length);
+        }
+
+        std::string errorReply() { return "E01"; }
+    }
+
+    /**
+     * @brief A stream socket accepting one connection at a time.
+     */
+    struct GdbStub::Transport
+    {
+        virtual ~Transport() {}
+        virtual void accept() = 0;
+        virtual size_t readSome(char* buffer, size_t length) = 0;
+        virtual void write(const std::string& data) = 0;
+        virtual size_t available() = 0;
+        virtual void close() = 0;
+    };
+
+    /**
+     * @brief The transport for a boost::asio stream protocol (tcp or local).
+     */
+    template <class Protocol>
+    class GdbStub::SocketTransport : public GdbStub::Transport
+    {
+    public:
+        SocketTransport(const typename Protocol::endpoint& endpoint)
+            : _acceptor(_io, endpoint), _socket(_io) {}
+
+        void accept() { _acceptor.accept(_socket); }
+        size_t readSome(char* buffer, size_t length) { return _socket.read_some(boost::asio::buffer(buffer, length)); }
+        void write(const std::string& data) { boost::asio::write(_socket, boost::asio::buffer(data)); }
+        size_t available() { return _socket.available(); }
+        void close() { _socket.close(); }
+
+        typename Protocol::endpoint localEndpoint() const { return _acceptor.local_endpoint(); }
+
+    private:
+        boost::asio::io_context _io;
+        typename Protocol::acceptor _acceptor;
+        typename Protocol::socket _socket;
+    };
+
+    GdbStub::GdbStub(MipsCPU& cpu)
+        : _cpu(cpu), _inputPos(0), _ack(true), _done(false), _signal(signal_trap)
+    {
+    }
+
+    GdbStub::~GdbStub()
+    {
+    }
+
+    unsigned short GdbStub::listenTcp(unsigned short port)
+    {
+        typedef boost::asio::ip::tcp tcp;
+        SocketTransport<tcp>* transport = new SocketTransport<tcp>(
+            tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+        _transport.reset(transport);
+        return transport->localEndpoint().port();
+    }
+
+    void GdbStub::listenUnix(const std::string& path)
+    {
+        typedef boost::asio::local::stream_protocol local;
+        std::remove(path.c_str());
+        _transport.reset(new SocketTransport<local>(local::endpoint(path)));
+    }
+
+    void GdbStub::serve()
+    {
+        if (!_transport) throw std::logic_error("GdbStub: not listening");
+
+        _transport->accept();
+        _input.clear();
+        _inputPos = 0;
+        _ack = true;
+        _done = false;
+
+        try
+        {
+            std::string packet;
+            while (!_done && readPacket(packet))
+            {
+                std::string reply = handle(packet);
+                // a kill gets no reply
+                if (!(_done && packet == "k")) sendPacket(reply);
+                // the OK is still acknowledged
+                if (packet == "QStartNoAckMode") _ack = false;
+            }
+        }
+        catch (const boost::system::system_error&)
+        {
+            // the debugger went away
+        }
+
+        _transport->close();
+    }
+
+    /**
+     * @return The next byte from the debugger, or -1 at the end of the connection.
+     */
+    int GdbStub::readChar()
+    {
+        if (_inputPos == _input.size())
+        {
+            char buffer[4096];
+            _input.assign(buffer, _transport->readSome(buffer, sizeof(buffer)));
+            _inputPos = 0;
+        }
+        return static_cast<unsigned char>(_input[_inputPos++]);
+    }
+
+    /**
+     * @brief Reads the next "$packet#checksum", acknowledging it.
+     *
+     * @return false if the connection ended.
+     */
+    bool GdbStub::readPacket(std::string& packet)
+    {
+        for (;;)
+        {
+            int c;
+            try
+            {
+                // acks and stray breaks are dropped while waiting for a packet
+                while ((c = readChar()) != '$');
+            }
+            catch (const boost::system::system_error&)
+            {
+                return false;
+            }
+
+            packet.clear();
+            unsigned char sum = 0;
+            while ((c = readChar()) != '#')
+            {
+                packet += static_cast<char>(c);
+                sum += static_cast<unsigned char>(c);
+            }
+
+            int high = hexValue(static_cast<char>(readChar()));
+            int low = hexValue(static_cast<char>(readChar()));
+            bool valid = high >= 0 && low >= 0 && ((high << 4) | low) == sum;
+
+            if (_ack) _transport->write(valid ? "+" : "-");
+            if (valid) return true;
+        }
+    }
+
+    void GdbStub::sendPacket(const std::string& packet)
+    {
+        unsigned char sum = 0;
+        for (size_t i = 0; i < packet.size(); ++i) sum += static_cast<unsigned char>(packet[i]);
+
+        std::string frame = "$" + packet + "#";
+        appendHex(frame, sum, 1);
+
+        // resend until acknowledged
+        for (;;)
+        {
+            _transport->write(frame);
+            if (!_ack) return;
+
+            int c;
+            while ((c = readChar()) != '+' && c != '-');
+            if (c == '+') return;
+        }
+    }
+
+    std::string GdbStub::handle(const std::string& packet)
+    {
+        if (packet.empty()) return "";
+
+        std::string args = packet.substr(1);
+        switch (packet[0])
+        {
+        case '?': return stopReply();
+        case 'g': return readRegisters();
+        case 'G': return writeRegisters(args);
+        case 'p': return readRegister(args);
+        case 'P': return writeRegister(args);
+        case 'm': return readMemory(args);
+        case 'M': return writeMemory(args);
+        case 'c': return resume(args, false);
+        case 's': return resume(args, true);
+        case 'Z': return setBreakpoint(args, true);
+        case 'z': return setBreakpoint(args, false);
+        case 'H': return "OK";
+        case 'T': return "OK";
+        case 'D': 
+            _done = true;
+            return "OK";
+        case 'k':
+            _done = true;
+            return "";
+        case 'q': return query(packet);
+        case 'Q': return packet == "QStartNoAckMode" ? "OK" : "";
+        default: return "";
+        }
+    }
+
+    std::string GdbStub::query(const std::string& packet) const
+    {
+        if (packet.compare(0, 11, "qSupported:") == 0 || packet == "qSupported") 
+            return "PacketSize=4000;QStartNoAckMode+";
+        if (packet == "qAttached") return "1";
+        if (packet == "qC") return "QC1";
+        if (packet == "qfThreadInfo") return "m1";
+        if (packet == "qsThreadInfo") return "l";
+        return "";
+    }
+
+    bool GdbStub::registerValue(int index, boost::uint32_t& value) const
+    {
+        if (index >= 0 && index < 32) value = _cpu.gprValue(index);
+        else if (index == reg_sr) value = _cpu.cop0(MipsCPU::cop0_status);
+        else if (index == reg_bad) value = _cpu.cop0(MipsCPU::cop0_badvaddr);
+        else if (index == reg_cause) value = _cpu.cop0(MipsCPU::cop0_cause);
+        else if (index == reg_lo) value = _cpu.lo();
+        else if (index == reg_hi) value = _cpu.hi();
+        else if (index == reg_pc) value = _cpu.pc();
+        else if (index >= reg_f0 && index < reg_fsr) value = _cpu.fprValue(index - reg_f0);
+        else if (index == reg_fsr) value = _cpu.fcsr();
+        else if (index == reg_fir) value = _cpu.fir();
+        else return false;
+        return true;
+    }
+
+    bool GdbStub::setRegister(int index, boost::uint32_t value)
+    {
+        if (index > 0 && index < 32) _cpu.setGPR(index, value);
+        else if (index == 0) return true;
+        else if (index == reg_sr) _cpu.setCop0(MipsCPU::cop0_status, value);
+        else if (index == reg_lo) _cpu.setLO(value);
+        else if (index == reg_hi) _cpu.setHI(value);
+        else if (index == reg_pc) _cpu.setPC(value);
+        else if (index >= reg_f0 && index < reg_fsr) _cpu.setFPR(index - reg_f0, value);
+        else if (index == reg_fsr) _cpu.setFCSR(value);
+        else return false;
+        return true;
+    }
+
+    std::string GdbStub::readRegisters() const
+    {
+        std::string reply;
+        for (int i = 0; i < reg_count; ++i)
+        {
+            boost::uint32_t value;
+            if (registerValue(i, value)) appendHex(reply, value, 4);
+            else reply += "xxxxxxxx";
+        }
+        return reply;
+    }
+
+    std::string GdbStub::writeRegisters(const std::string& args)
+    {
+        for (int i = 0; i < reg_count && (i + 1) * 8 <= int(args.size()); ++i)
+        {
+            std::string digits = args.substr(i * 8, 8);
+            size_t pos = 0;
+            boost::uint32_t value;
+            // unavailable registers come back as x's and are skipped
+            if (parseHex(digits, pos, value) && pos == digits.size()) setRegister(i, value);
+        }
+        return "OK";
+    }
+
+    std::string GdbStub::readRegister(const std::string& args) const
+    {
+        size_t pos = 0;
+        boost::uint32_t index, value;
+        if (!parseHex(args, pos, index)) return errorReply();
+        if (!registerValue(index, value)) return "xxxxxxxx";
+
+        std::string reply;
+        appendHex(reply, value, 4);
+        return reply;
+    }
+
+    std::string GdbStub::writeRegister(const std::string& args)
+    {
+        size_t pos = 0;
+        boost::uint32_t index, value;
+        if (!parseHex(args, pos, index) || pos >= args.size() || args[pos] != '=') return errorReply();
+        ++pos;
+        if (!parseHex(args, pos, value)) return errorReply();
+        return setRegister(index, value) ? "OK" : errorReply();
+    }
+
+    std::string GdbStub::readMemory(const std::string& args) const
+    {
+        size_t pos = 0;
+        boost::uint32_t addr, length;
+        const Memory* memory = _cpu.memory().get();
+        if (!memory || !parseRange(args, pos, addr, length)) return errorReply();
+        if (length > 0 && (!memory->contains(addr) || !memory->contains(addr + length - 1))) return errorReply();
+
+        std::string reply;
+        for (boost::uint32_t a = addr; a != addr + length; ++a)
+            appendHex(reply, memory->readWord(a) >> (24 - 8 * (a & 3)), 1);
+        return reply;
+    }
+
+    std::string GdbStub::writeMemory(const std::string& args)
+    {
+        size_t pos = 0;
+        boost::uint32_t addr, length;
+        Memory* memory = _cpu.memory().get();
+        if (!memory || !parseRange(args, pos, addr, length) || pos >= args.size() || args[pos] != ':') 
+            return errorReply();
+        ++pos;
+        if (args.size() - pos < length * 2) return errorReply();
+        if (length > 0 && (!memory->contains(addr) || !memory->contains(addr + length - 1))) return errorReply();
+
+        for (boost::uint32_t a = addr; a != addr + length; ++a, pos += 2)
+        {
+            int high = hexValue(args[pos]), low = hexValue(args[pos + 1]);
+            if (high < 0 || low < 0) return errorReply();
+
+            unsigned shift = 24 - 8 * (a & 3);
+            boost::uint32_t word = memory->readWord(a) & ~(0xFFu << shift);
+            memory->writeWord(a, word | (boost::uint32_t((high << 4) | low) << shift));
+        }
+        return "OK";
+    }
+
+    /**
+     * @brief Z/z packets: "type,addr,kind". Software and hardware 
+     * breakpoints are the same; only write watchpoints are supported.
+     */
+    std::string GdbStub::setBreakpoint(const std::string& args, bool insert)
+    {
+        size_t pos = 2;
+        boost::uint32_t addr, length;
+        if (args.size() < 2 || args[1] != ',' || !parseRange(args, pos, addr, length)) return errorReply();
+
+        switch (args[0])
+        {
+        case '0':
+        case '1':
+            if (insert) _cpu.addBreakpoint(addr);
+            else _cpu.removeBreakpoint(addr);
+            return "OK";
+        case '2':
+            if (insert) _cpu.addWatchpoint(addr, length);
+            else _cpu.removeWatchpoint(addr, length);
+            return "OK";
+        default:
+            return "";
+        }
+    }
+
+    /**
+     * @brief Checks for a break from the debugger without blocking.
+     */
+    bool GdbStub::interrupted()
+    {
+        while (_inputPos < _input.size() || _transport->available() > 0)
+            if (readChar() == 0x03) return true;
+        return false;
+    }
+
+    /**
+     * @brief c and s packets, with an optional address to resume at.
+     */
+    std::string GdbStub::resume(const std::string& args, bool step)
+    {
+        size_t pos = 0;
+        boost::uint32_t addr;
+        if (parseHex(args, pos, addr)) _cpu.setPC(addr);
+
+        _signal = signal_trap;
+        if (step)
+        {
+            _cpu.stepProgram(1);
+            return stopReply();
+        }
+
+        for (;;)
+        {
+            int executed = _cpu.stepProgram(continue_slice);
+            if (_cpu.halted() || _cpu.debugStop() != MipsCPU::debug_none) break;
+
+            if (interrupted())
+            {
+                _signal = signal_int;
+                break;
+            }
+
+            // a blocked host call is waited for; other early stops are reported
+            if (executed < continue_slice)
+            {
+                if (!_cpu.blocked())
+                {
+                    _signal = signal_int;
+                    break;
+                }
+                boost::this_thread::yield();
+            }
+        }
+        return stopReply();
+    }
+
+    std::string GdbStub::stopReply() const
+    {
+        if (_cpu.halted()) return "W00";
+
+        std::string reply = "T";
+        appendHex(reply, _signal, 1);
+        if (_cpu.debugStop() == MipsCPU::debug_watchpoint)
+        {
+            reply += "watch:";
+            appendHex(reply, _cpu.watchAddress(), 4);
+            reply += ";";
+        }
+        return reply;
+    }
+
+} // tememu
@@ -0,0 +1,107 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _GDBSTUB_H
+#define _GDBSTUB_H
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <string>
+
+namespace tememu
+{
+    class MipsCPU;
+
+    /**
+     * @brief A GDB remote serial protocol server for one CPU.
+     *
+     * Listens on loopback TCP or a Unix domain socket and serves one 
+     * debugger (e.g. gdb-multiarch with "target remote :port") at a time. 
+     * Supports register and memory access, breakpoints, write watchpoints,
+     * single-step and continue. Continue runs the CPU at full speed in 
+     * large slices and only checks for a break (Ctrl-C) in between.
+     *
+     * Registers follow gdb's mips register numbering (r0..r31, sr, lo, hi,
+     * bad, cause, pc, f0..f31, fsr, fir); registers the CPU does not have
+     * are reported unavailable. Values and memory are sent big-endian, 
+     * the default byte order of gdb's mips target.
+     *
+     * The CPU must not be run by anyone else while a debugger is served.
+     */
+    class GdbStub : boost::noncopyable
+    {
+    public:
+        explicit GdbStub(MipsCPU& cpu);
+        ~GdbStub();
+
+        // binds to 127.0.0.1; port 0 picks a free port, which is returned
+        unsigned short listenTcp(unsigned short port);
+        void listenUnix(const std::string& path);
+
+        // waits for a debugger and serves it until it detaches or disconnects
+        void serve();
+
+        // instructions run between two checks for a break from the debugger
+        static const int continue_slice = 1 << 20;
+
+    private:
+        struct Transport;
+        template <class Protocol> class SocketTransport;
+
+        bool readPacket(std::string& packet);
+        void sendPacket(const std::string& packet);
+        int readChar();
+
+        std::string handle(const std::string& packet);
+        std::string readRegisters() const;
+        std::string writeRegisters(const std::string& args);
+        std::string readRegister(const std::string& args) const;
+        std::string writeRegister(const std::string& args);
+        std::string readMemory(const std::string& args) const;
+        std::string writeMemory(const std::string& args);
+        std::string setBreakpoint(const std::string& args, bool insert);
+        std::string resume(const std::string& args, bool step);
+        std::string query(const std::string& packet) const;
+        std::string stopReply() const;
+        bool interrupted();
+
+        bool registerValue(int index, boost::uint32_t& value) const;
+        bool setRegister(int index, boost::uint32_t value);
+
+    private:
+        MipsCPU& _cpu;
+        boost::scoped_ptr<Transport> _transport;
+        std::string _input;
+        size_t _inputPos;
+        bool _ack;
+        bool _done;
+        // the signal reported by the last stop
+        int _signal;
+    };
+
+} // tememu
+
+#endif //include guard
@@ -0,0 +1,66 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _HOOKS_H
+#define _HOOKS_H
+
+#include <FastDelegate.h>
+
+#include <boost/cstdint.hpp>
+
+namespace tememu
+{
+    // pc, instruction
+    typedef fastdelegate::FastDelegate2<boost::uint32_t, boost::int32_t> InstructionHook;
+    // pc of the branch or jump, target (reached after the delay slot)
+    typedef fastdelegate::FastDelegate2<boost::uint32_t, boost::uint32_t> BranchHook;
+    // address, value loaded or stored
+    typedef fastdelegate::FastDelegate2<boost::uint32_t, boost::uint32_t> MemoryHook;
+    // pc of the first instruction of the block
+    typedef fastdelegate::FastDelegate1<boost::uint32_t> BlockHook;
+
+    /**
+     * @brief Callbacks for analysis tools, see MipsCPU::setHooks.
+     *
+     * Bind the ones you need with fastdelegate::MakeDelegate and leave the
+     * others empty. A block starts at every instruction that is not the
+     * sequential successor of the previously retired one.
+     */
+    struct Hooks
+    {
+        InstructionHook instructionRetired;
+        BranchHook branchTaken;
+        MemoryHook memoryRead;
+        MemoryHook memoryWrite;
+        BlockHook blockEntry;
+
+        bool empty() const
+        {
+            return !instructionRetired && !branchTaken && !memoryRead && !memoryWrite && !blockEntry;
+        }
+    };
+
+} // tememu
+
+#endif //include guard
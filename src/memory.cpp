@@ -0,0 +1,273 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "memory.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace tememu 
+{
+    Memory::Memory(size_t sizeInBytes)
+        : _words(new boost::atomic<uint32>[sizeInBytes / sizeof(uint32)]), 
+          _wordCount(sizeInBytes / sizeof(uint32)), _textEnd(0)
+    {
+        for (size_t i = 0; i < _wordCount; ++i) 
+            _words[i].store(0, boost::memory_order_relaxed);
+
+        _pageFlags.reset(new boost::uint8_t[pageCount()]);
+        std::fill(_pageFlags.get(), _pageFlags.get() + pageCount(), 0);
+    }
+
+    const unsigned Memory::page_shift;
+    const unsigned Memory::page_word_shift;
+    const size_t Memory::page_words;
+
+    /**
+     * @brief Starts a new tracking interval: the first write to each page
+     * saves its old contents. Images of the previous interval are dropped.
+     */
+    void Memory::trackPages()
+    {
+        _pageImages.clear();
+        setPageFlags(page_tracked, true);
+    }
+
+    /**
+     * @brief Hands out the images saved since trackPages or the last call,
+     * and starts a new interval.
+     */
+    void Memory::takePageImages(std::vector<PageImage>& images)
+    {
+        images.clear();
+        images.swap(_pageImages);
+
+        for (size_t i = 0; i < images.size(); ++i)
+            _pageFlags[images[i].page] |= page_tracked;
+    }
+
+    /**
+     * @brief Writes saved page images back, bypassing tracking.
+     */
+    void Memory::restorePages(const std::vector<PageImage>& images)
+    {
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            size_t first = size_t(images[i].page) << page_word_shift;
+
+            for (size_t w = 0; w < images[i].words.size(); ++w)
+                _words[first + w].store(images[i].words[w], boost::memory_order_relaxed);
+        }
+    }
+
+    void Memory::stopTrackingPages()
+    {
+        setPageFlags(page_tracked, false);
+        _pageImages.clear();
+    }
+
+    void Memory::setPageFlag(uint32 addr, boost::uint8_t flag, bool set)
+    {
+        size_t page = index(addr) >> page_word_shift;
+        if (set) _pageFlags[page] |= flag;
+        else _pageFlags[page] &= ~flag;
+    }
+
+    /**
+     * @brief Starts calling the handler of watcher for writes to 
+     * [addr, addr + length).
+     */
+    void Memory::watch(const void* watcher, uint32 addr, uint32 length, const WatchHandler& handler)
+    {
+        if (length == 0 || !contains(addr) || !contains(addr + length - 1))
+            throw std::out_of_range("Memory::watch: range out of memory");
+
+        Watch watch = { watcher, addr, length, handler };
+
+        boost::mutex::scoped_lock lock(_watchMutex);
+        _watches.push_back(watch);
+        for (uint32 page = addr >> page_shift; page <= (addr + length - 1) >> page_shift; ++page)
+            _pageFlags[page] |= page_watched;
+    }
+
+    /**
+     * @brief Removes a range added by watch; pages keep their flag while 
+     * other ranges, of any watcher, still cover them.
+     */
+    void Memory::unwatch(const void* watcher, uint32 addr, uint32 length)
+    {
+        boost::mutex::scoped_lock lock(_watchMutex);
+
+        for (size_t i = 0; i < _watches.size(); ++i)
+        {
+            if (_watches[i].watcher == watcher && _watches[i].addr == addr && _watches[i].length == length)
+            {
+                _watches.erase(_watches.begin() + i);
+                flagWatchedPages();
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Removes every range of watcher, which is not called any more
+     * once this returns.
+     */
+    void Memory::unwatchAll(const void* watcher)
+    {
+        boost::mutex::scoped_lock lock(_watchMutex);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < _watches.size(); ++i)
+        {
+            if (_watches[i].watcher != watcher) _watches[kept++] = _watches[i];
+        }
+
+        _watches.resize(kept);
+        flagWatchedPages();
+    }
+
+    void Memory::flagWatchedPages()
+    {
+        setPageFlags(page_watched, false);
+
+        for (size_t i = 0; i < _watches.size(); ++i)
+        {
+            uint32 first = _watches[i].addr;
+            uint32 last = first + _watches[i].length - 1;
+            for (uint32 page = first >> page_shift; page <= last >> page_shift; ++page)
+                _pageFlags[page] |= page_watched;
+        }
+    }
+
+    /**
+     * @brief The slow path of writes to a page with write flags set.
+     */
+    void Memory::pageWritten(size_t word)
+    {
+        size_t page = word >> page_word_shift;
+
+        if (_pageFlags[page] & page_watched)
+        {
+            uint32 addr = static_cast<uint32>(word << 2);
+            boost::mutex::scoped_lock lock(_watchMutex);
+
+            for (size_t i = 0; i < _watches.size(); ++i)
+            {
+                // any byte of the word in the range
+                if (addr + 3 >= _watches[i].addr && addr < _watches[i].addr + _watches[i].length)
+                    _watches[i].handler(addr);
+            }
+        }
+
+        if (_pageFlags[page] & page_tracked)
+        {
+            size_t first = page << page_word_shift;
+            size_t count = std::min(page_words, _wordCount - first);
+
+            _pageImages.push_back(PageImage());
+            PageImage& image = _pageImages.back();
+            image.page = static_cast<uint32>(page);
+            image.words.resize(count);
+
+            for (size_t w = 0; w < count; ++w)
+                image.words[w] = _words[first + w].load(boost::memory_order_relaxed);
+
+            _pageFlags[page] &= ~page_tracked;
+        }
+    }
+
+    void Memory::setPageFlags(boost::uint8_t flag, bool set)
+    {
+        for (size_t page = 0; page < pageCount(); ++page)
+        {
+            if (set) _pageFlags[page] |= flag;
+            else _pageFlags[page] &= ~flag;
+        }
+    }
+
+    /**
+     * @brief Copies the program to the beginning of the memory.
+     *
+     * The end of the program marks the end of the text segment; cores
+     * stop running when their PC leaves it.
+     */
+    void Memory::loadProgram(const std::vector<boost::int32_t>& program)
+    {
+        if (program.size() > _wordCount)
+            throw std::out_of_range("Memory::loadProgram: program does not fit");
+
+        for (size_t i = 0; i < program.size(); ++i)
+            _words[i].store(program[i], boost::memory_order_relaxed);
+
+        _textEnd = program.size() * sizeof(uint32);
+    }
+
+    /**
+     * @brief Copies every word of the memory, for snapshots.
+     */
+    void Memory::save(std::vector<uint32>& words) const
+    {
+        words.resize(_wordCount);
+        for (size_t i = 0; i < _wordCount; ++i)
+            words[i] = _words[i].load(boost::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Overwrites the whole memory with a saved image of the same size.
+     */
+    void Memory::restore(const std::vector<uint32>& words, uint32 textEnd)
+    {
+        if (words.size() != _wordCount)
+            throw std::invalid_argument("Memory::restore: image size does not match");
+
+        for (size_t i = 0; i < _wordCount; ++i)
+            _words[i].store(words[i], boost::memory_order_relaxed);
+
+        _textEnd = textEnd;
+    }
+
+    void StoreBuffer::write(const Memory& memory, uint32 addr, uint32 value)
+    {
+        if (!memory.contains(addr)) throw std::out_of_range("Memory: address out of range");
+        _values[addr & ~3u] = value;
+    }
+
+    void StoreBuffer::commit(Memory& memory)
+    {
+        for (boost::unordered_map<uint32, uint32>::const_iterator it = _values.begin(); 
+             it != _values.end(); ++it)
+        {
+            memory.writeWord(it->first, it->second);
+        }
+
+        _values.clear();
+    }
+
+    void Memory::outOfRange()
+    {
+        throw std::out_of_range("Memory: address out of range");
+    }
+
+} // tememu
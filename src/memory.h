@@ -0,0 +1,199 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _TEMEMU_MEMORY_H
+#define _TEMEMU_MEMORY_H
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace tememu 
+{
+    typedef boost::uint32_t uint32;
+
+    /**
+     * @brief The contents of one page before it was first written, see 
+     * Memory::trackPages.
+     */
+    struct PageImage
+    {
+        uint32 page;
+        std::vector<uint32> words;
+    };
+
+    /**
+     * @brief Word addressed guest memory that can be shared between cores.
+     *
+     * Every word is a host atomic, so plain loads and stores are relaxed
+     * accesses (ordinary moves on x86) while LL/SC and SYNC can be built on
+     * compare-and-swap and fences. The program text is loaded at address 0.
+     *
+     * Writes check a flag byte of their page. The flags are only set while
+     * a feature is watching the page, so writes elsewhere take no slow path.
+     * Page tracking is meant for a single writer; it is not safe with cores
+     * writing the memory concurrently.
+     */
+    class Memory : boost::noncopyable
+    {
+    public:
+        explicit Memory(size_t sizeInBytes);
+
+        void loadProgram(const std::vector<boost::int32_t>& program);
+        void save(std::vector<uint32>& words) const;
+        void restore(const std::vector<uint32>& words, uint32 textEnd);
+
+        uint32 readWord(uint32 addr) const 
+        { 
+            return _words[index(addr)].load(boost::memory_order_relaxed); 
+        }
+
+        void writeWord(uint32 addr, uint32 value) 
+        { 
+            size_t i = index(addr);
+            if (_pageFlags[i >> page_word_shift] & page_write_flags) pageWritten(i);
+            _words[i].store(value, boost::memory_order_relaxed); 
+        }
+
+        bool compareAndSwap(uint32 addr, uint32 expected, uint32 desired)
+        {
+            size_t i = index(addr);
+            if (_pageFlags[i >> page_word_shift] & page_write_flags) pageWritten(i);
+            return _words[i].compare_exchange_strong(expected, desired, 
+                boost::memory_order_acq_rel, boost::memory_order_relaxed);
+        }
+
+        static void fence() { boost::atomic_thread_fence(boost::memory_order_seq_cst); }
+
+        bool contains(uint32 addr) const { return (addr >> 2) < _wordCount; }
+        size_t size() const { return _wordCount * sizeof(uint32); }
+        uint32 textEnd() const { return _textEnd; }
+
+        // write tracking at page granularity, for checkpoints
+        static const unsigned page_shift = 12;
+        size_t pageCount() const { return (_wordCount + page_words - 1) >> page_word_shift; }
+        void trackPages();
+        void takePageImages(std::vector<PageImage>& images);
+        void restorePages(const std::vector<PageImage>& images);
+        void stopTrackingPages();
+
+        // bits of the per-page flags; a page without write flags costs writes one test
+        enum 
+        { 
+            page_tracked = 1,       // save the page on its first write
+            page_watched = 2,       // has write watchpoints
+            page_breakpoints = 4,   // has breakpoints, see MipsCPU
+            page_write_flags = page_tracked | page_watched
+        };
+
+        boost::uint8_t pageFlags(uint32 addr) const { return _pageFlags[index(addr) >> page_word_shift]; }
+        void setPageFlag(uint32 addr, boost::uint8_t flag, bool set);
+
+        /**
+         * @brief Write watchpoints. Every watcher (a CPU) has its own ranges
+         * and handler. The handler is called with the address before a word
+         * in one of its ranges is written, on the thread of the writing core.
+         */
+        typedef boost::function<void (uint32)> WatchHandler;
+        void watch(const void* watcher, uint32 addr, uint32 length, const WatchHandler& handler);
+        void unwatch(const void* watcher, uint32 addr, uint32 length);
+        void unwatchAll(const void* watcher);
+
+    private:
+        static const unsigned page_word_shift = page_shift - 2;
+        static const size_t page_words = size_t(1) << page_word_shift;
+
+        void pageWritten(size_t word);
+        void setPageFlags(boost::uint8_t flag, bool set);
+        void flagWatchedPages();
+
+        struct Watch
+        {
+            const void* watcher;
+            uint32 addr, length;
+            WatchHandler handler;
+        };
+
+    private:
+        size_t index(uint32 addr) const
+        {
+            size_t i = addr >> 2;
+            if (i >= _wordCount) outOfRange();
+            return i;
+        }
+
+        static void outOfRange();
+
+    private:
+        boost::scoped_array< boost::atomic<uint32> > _words;
+        size_t _wordCount;
+        uint32 _textEnd;
+
+        boost::scoped_array<boost::uint8_t> _pageFlags;
+        std::vector<PageImage> _pageImages;
+
+        // any core may write a watched page while another adds a watch
+        boost::mutex _watchMutex;
+        std::vector<Watch> _watches;
+    };
+
+    /**
+     * @brief Private stores of one core during a deterministic quantum.
+     *
+     * Loads see the core's own buffered stores and otherwise the memory as 
+     * it was at the last barrier. Only the last value stored to an address
+     * is kept; nobody can observe the intermediate ones before the commit.
+     */
+    class StoreBuffer
+    {
+    public:
+        uint32 read(const Memory& memory, uint32 addr) const
+        {
+            if (!_values.empty())
+            {
+                boost::unordered_map<uint32, uint32>::const_iterator it = _values.find(addr & ~3u);
+                if (it != _values.end()) return it->second;
+            }
+            return memory.readWord(addr);
+        }
+
+        void write(const Memory& memory, uint32 addr, uint32 value);
+        void commit(Memory& memory);
+        bool empty() const { return _values.empty(); }
+
+    private:
+        boost::unordered_map<uint32, uint32> _values;
+    };
+
+} // tememu
+
+#endif //include guard
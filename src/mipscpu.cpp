@@ -23,71 +23,393 @@
  */
  
 #include "consts.h"
+#include "disasm.h"
 #include "mipscpu.h"
 
+#include <boost/bind.hpp>
+#include <boost/config.hpp>
+#include <boost/unordered_map.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <bitset>
+#include <climits>
+#include <cmath>
 #include <cstring>
 #include <iostream>
+#include <stdexcept>
 
 
 namespace tememu 
 {
-#ifndef TRACE_OPCODES
-    #define REG_OP_FUNC(fn,code) this->_fnMap[(code)] = (&tememu::MipsCPU::fn)
+    namespace
+    {
+        // never the address of an instruction, so the next one starts a block
+        const boost::uint32_t no_block = 0xFFFFFFFF;
+
+        bool isBranch(boost::int32_t instr)
+        {
+            switch (OPCODE(instr))
+            {
+            case 0x00: return FUNCT(instr) == 0x08 || FUNCT(instr) == 0x09;
+            case 0x02: case 0x03: case 0x04: case 0x05: return true;
+            case 0x11: return RS(instr) == 0x08; // bc1f, bc1t
+            default: return false;
+            }
+        }
+
+        // interrupt lines share the pending event word with the stop request
+        void checkInterruptLine(int line)
+        {
+            if (line < 0 || line >= 32 || !((MipsCPU::event_interrupt_mask >> line) & 1))
+                throw std::out_of_range("MipsCPU: no such interrupt line");
+        }
+
+        // FIR: single, double and word formats are implemented
+        const int32 fir_value = 0x00030000;
+
+        // COP0 fields
+        const boost::uint32_t status_ie = 0x00000001;
+        const boost::uint32_t status_exl = 0x00000002;
+        const boost::uint32_t cause_exc_code = 0x0000007C;
+        const boost::uint32_t cause_bd = 0x80000000;
+        const boost::uint32_t cause_ip = 0x0000FF00;
+        const boost::uint32_t cause_software = 0x00000300;
+        const boost::uint32_t cause_timer = 0x00008000; // IP7
+        const boost::uint32_t exception_offset = 0x180;
+        // the PC after a jump to an unaligned target, see badFetch
+        const boost::uint32_t fetch_fault_pc = 0xFFFFFFFF;
+        // kseg0, far outside any program text
+        const boost::uint32_t default_exception_base = 0x80000000;
+        // Count wraps around after this many instructions
+        const boost::uint64_t timer_period = boost::uint64_t(1) << 32;
+
+        /*
+         * Signed overflow checks for add, addi and sub: one flag test after
+         * the host add, like the hardware does.
+         */
+        inline bool addOverflows(int32 a, int32 b, int32& result)
+        {
+#if defined(__GNUC__) && __GNUC__ >= 5
+            return __builtin_add_overflow(a, b, &result);
 #else
-    #define REG_OP_FUNC(fn,code) this->_fnMap[(code)] = (&tememu::MipsCPU::fn); this->_opNameMap[(code)] = #fn
+            boost::int64_t wide = boost::int64_t(a) + b;
+            result = int32(wide);
+            return wide != result;
 #endif
+        }
 
-    MipsCPU::MipsCPU()
-        : _HI(0), _LO(0), _PC(4), _nPC(4), _FCSR(0)
+        inline bool subOverflows(int32 a, int32 b, int32& result)
+        {
+#if defined(__GNUC__) && __GNUC__ >= 5
+            return __builtin_sub_overflow(a, b, &result);
+#else
+            boost::int64_t wide = boost::int64_t(a) - b;
+            result = int32(wide);
+            return wide != result;
+#endif
+        }
+
+        // FCSR fields
+        const boost::uint32_t fcsr_rounding = 0x00000003;
+        const boost::uint32_t fcsr_flush = 0x01000000;
+        const boost::uint32_t fcsr_mode = fcsr_rounding | fcsr_flush;
+
+#if defined(__SSE2__)
+        /**
+         * @brief The MXCSR value for the guest's FCSR: the rounding mode 
+         * (nearest, zero, +inf, -inf on MIPS) and flush to zero.
+         */
+        boost::uint32_t guestMxcsr(boost::uint32_t mxcsr, boost::uint32_t fcsr)
+        {
+            static const boost::uint32_t rounding[] = { 0x0000, 0x6000, 0x4000, 0x2000 };
+            return (mxcsr & ~0xE000u) | rounding[fcsr & fcsr_rounding] | (fcsr & fcsr_flush ? 0x8000 : 0);
+        }
+#endif
+
+        /**
+         * @brief Applies the guest rounding mode to the host for one run of 
+         * the CPU, and puts the host's back.
+         *
+         * FPU instructions are plain host float and double operations, 
+         * which are SSE2 scalar instructions on x86-64 and follow MXCSR. 
+         * MXCSR is only written when the guest mode differs from the 
+         * host's (usually it does not), and by op_ctc1 when the guest 
+         * changes it while running. Host call handlers run with the guest
+         * mode. Without SSE2 the host default mode is used.
+         */
+        class GuestRounding
+        {
+        public:
+#if defined(__SSE2__)
+            explicit GuestRounding(boost::uint32_t fcsr) : _host(_mm_getcsr())
+            {
+                boost::uint32_t guest = guestMxcsr(_host, fcsr);
+                if (guest != _host) _mm_setcsr(guest);
+            }
+
+            ~GuestRounding() 
+            { 
+                if (_mm_getcsr() != _host) _mm_setcsr(_host); 
+            }
+
+        private:
+            boost::uint32_t _host;
+#else
+            explicit GuestRounding(boost::uint32_t) {}
+#endif
+        };
+
+        // float to word conversions; out of range and NaN give 2^31 - 1, as on MIPS
+        int32 toWord(float value, bool truncate)
+        {
+#if defined(__SSE2__)
+            __m128 v = _mm_set_ss(value);
+            int32 word = truncate ? _mm_cvttss_si32(v) : _mm_cvtss_si32(v);
+#else
+            int32 word = int32(value);
+#endif
+            return word == INT_MIN && value != -2147483648.0f ? INT_MAX : word;
+        }
+
+        int32 toWord(double value, bool truncate)
+        {
+#if defined(__SSE2__)
+            __m128d v = _mm_set_sd(value);
+            int32 word = truncate ? _mm_cvttsd_si32(v) : _mm_cvtsd_si32(v);
+#else
+            int32 word = int32(value);
+#endif
+            return word == INT_MIN && value != -2147483648.0 ? INT_MAX : word;
+        }
+    }
+
+#define SPECIAL_OP(funct) (64 + (funct))
+#define SPECIAL2_OP(funct) (128 + (funct))
+#define COP1_OP(rs) (192 + (rs))
+#define COP1_S_OP(funct) (224 + (funct))
+#define COP1_D_OP(funct) (288 + (funct))
+#define COP1_W_OP(funct) (352 + (funct))
+#define REG_OP_FUNC(fn,code) this->handlers[(code)] = (&tememu::MipsCPU::fn); this->names[(code)] = #fn
+
+    /**
+     * @brief The dispatch table, indexed by internal opcode.
+     *
+     * Primary opcodes are used as they are, SPECIAL instructions (opcode 0)
+     * are at SPECIAL_OP(funct) and SPECIAL2 ones (opcode 0x1C) at 
+     * SPECIAL2_OP(funct). COP1 arithmetic is at COP1_S/D/W_OP(funct) by 
+     * format, the other COP1 instructions at COP1_OP(rs). There is a 
+     * single table for all instances.
+     */
+    struct MipsCPU::OpcodeTable
     {
-        _GPR.reserve(gpr_count); 
-        _FPR.reserve(fpr_count);
-        _FCR.reserve(fcr_count);
+        OpcodeFn handlers[internal_opcode_count];
+        const char* names[internal_opcode_count];
 
-        for ( int i = 0; i < gpr_count; ++i ) _GPR.push_back(0);
-        for ( int i = 0; i < fpr_count; ++i ) _FPR.push_back(0);
-        for ( int i = 0; i < fcr_count; ++i ) _FCR.push_back(0);
+        OpcodeTable();
+    };
 
-        // set up instruction table
-        // see runDecodedInstr for the construction of the constants
-        // 0 opcode instructions internal opcodes = funct << 4.
+    MipsCPU::OpcodeTable::OpcodeTable()
+    {
+        for ( int i = 0; i < internal_opcode_count; ++i ) 
+        {
+            handlers[i] = 0;
+            names[i] = "unknown";
+        }
 
-        REG_OP_FUNC(op_add,     0x20 << 4);
-        REG_OP_FUNC(op_addu,    0x21 << 4);
-        REG_OP_FUNC(op_sub,     0x22 << 4);
-        REG_OP_FUNC(op_subu,    0x23 << 4);
+        REG_OP_FUNC(op_add,     SPECIAL_OP(0x20));
+        REG_OP_FUNC(op_addu,    SPECIAL_OP(0x21));
+        REG_OP_FUNC(op_sub,     SPECIAL_OP(0x22));
+        REG_OP_FUNC(op_subu,    SPECIAL_OP(0x23));
         REG_OP_FUNC(op_addi,    0x08);
         REG_OP_FUNC(op_addiu,   0x09);
-        REG_OP_FUNC(op_mult,    0x18 << 4);
-        REG_OP_FUNC(op_div,     0x1A << 4);
-        REG_OP_FUNC(op_divu,    0x1B << 4);
+        REG_OP_FUNC(op_mult,    SPECIAL_OP(0x18));
+        REG_OP_FUNC(op_multu,   SPECIAL_OP(0x19));
+        REG_OP_FUNC(op_madd,    SPECIAL2_OP(0x00));
+        REG_OP_FUNC(op_maddu,   SPECIAL2_OP(0x01));
+        REG_OP_FUNC(op_mul,     SPECIAL2_OP(0x02));
+        REG_OP_FUNC(op_msub,    SPECIAL2_OP(0x04));
+        REG_OP_FUNC(op_msubu,   SPECIAL2_OP(0x05));
+        REG_OP_FUNC(op_div,     SPECIAL_OP(0x1A));
+        REG_OP_FUNC(op_divu,    SPECIAL_OP(0x1B));
 
         REG_OP_FUNC(op_beq,     0x04);
         REG_OP_FUNC(op_bne,     0x05);
         REG_OP_FUNC(op_j,       0x02);
         REG_OP_FUNC(op_jal,     0x03);
-        REG_OP_FUNC(op_jr,      0x08 << 4);
+        REG_OP_FUNC(op_jr,      SPECIAL_OP(0x08));
+        REG_OP_FUNC(op_jalr,    SPECIAL_OP(0x09));
+
+        REG_OP_FUNC(op_mfhi,    SPECIAL_OP(0x10));
+        REG_OP_FUNC(op_mthi,    SPECIAL_OP(0x11));
+        REG_OP_FUNC(op_mflo,    SPECIAL_OP(0x12));
+        REG_OP_FUNC(op_mtlo,    SPECIAL_OP(0x13));
+
+        REG_OP_FUNC(op_syscall, SPECIAL_OP(0x0C));
+        REG_OP_FUNC(op_break,   SPECIAL_OP(0x0D));
+        REG_OP_FUNC(op_cop0,    0x10);
 
-        REG_OP_FUNC(op_mfhi,    0x10 << 4);
-        REG_OP_FUNC(op_mthi,    0x11 << 4);
-        REG_OP_FUNC(op_mflo,    0x12 << 4);
-        REG_OP_FUNC(op_mtlo,    0x13 << 4);
+        REG_OP_FUNC(op_lw,      0x23);
+        REG_OP_FUNC(op_sw,      0x2B);
+        REG_OP_FUNC(op_ll,      0x30);
+        REG_OP_FUNC(op_sc,      0x38);
+        REG_OP_FUNC(op_sync,    SPECIAL_OP(0x0F));
 
-        REG_OP_FUNC(op_and,     0x24 << 4);
+        REG_OP_FUNC(op_and,     SPECIAL_OP(0x24));
         REG_OP_FUNC(op_andi,    0x0C);
-        REG_OP_FUNC(op_or,      0x25 << 4);
+        REG_OP_FUNC(op_or,      SPECIAL_OP(0x25));
         REG_OP_FUNC(op_ori,     0x0D);
-        REG_OP_FUNC(op_xor,     0x26 << 4);
-        REG_OP_FUNC(op_nor,     0x27 << 4);
+        REG_OP_FUNC(op_xor,     SPECIAL_OP(0x26));
+        REG_OP_FUNC(op_nor,     SPECIAL_OP(0x27));
+
+        REG_OP_FUNC(op_sll,     SPECIAL_OP(0x00));
+        REG_OP_FUNC(op_srl,     SPECIAL_OP(0x02));
+        REG_OP_FUNC(op_sra,     SPECIAL_OP(0x03));
+        REG_OP_FUNC(op_sllv,    SPECIAL_OP(0x04));
+        REG_OP_FUNC(op_srlv,    SPECIAL_OP(0x06));
+        REG_OP_FUNC(op_srav,    SPECIAL_OP(0x07));
+
+        REG_OP_FUNC(op_mfc1,    COP1_OP(0x00));
+        REG_OP_FUNC(op_cfc1,    COP1_OP(0x02));
+        REG_OP_FUNC(op_mtc1,    COP1_OP(0x04));
+        REG_OP_FUNC(op_ctc1,    COP1_OP(0x06));
+        REG_OP_FUNC(op_bc1,     COP1_OP(0x08));
+        REG_OP_FUNC(op_lwc1,    0x31);
+        REG_OP_FUNC(op_swc1,    0x39);
+
+        REG_OP_FUNC(op_add_s,     COP1_S_OP(0x00));
+        REG_OP_FUNC(op_sub_s,     COP1_S_OP(0x01));
+        REG_OP_FUNC(op_mul_s,     COP1_S_OP(0x02));
+        REG_OP_FUNC(op_div_s,     COP1_S_OP(0x03));
+        REG_OP_FUNC(op_sqrt_s,    COP1_S_OP(0x04));
+        REG_OP_FUNC(op_abs_s,     COP1_S_OP(0x05));
+        REG_OP_FUNC(op_mov_s,     COP1_S_OP(0x06));
+        REG_OP_FUNC(op_neg_s,     COP1_S_OP(0x07));
+        REG_OP_FUNC(op_trunc_w_s, COP1_S_OP(0x0D));
+        REG_OP_FUNC(op_cvt_d_s,   COP1_S_OP(0x21));
+        REG_OP_FUNC(op_cvt_w_s,   COP1_S_OP(0x24));
+
+        REG_OP_FUNC(op_add_d,     COP1_D_OP(0x00));
+        REG_OP_FUNC(op_sub_d,     COP1_D_OP(0x01));
+        REG_OP_FUNC(op_mul_d,     COP1_D_OP(0x02));
+        REG_OP_FUNC(op_div_d,     COP1_D_OP(0x03));
+        REG_OP_FUNC(op_sqrt_d,    COP1_D_OP(0x04));
+        REG_OP_FUNC(op_abs_d,     COP1_D_OP(0x05));
+        REG_OP_FUNC(op_mov_d,     COP1_D_OP(0x06));
+        REG_OP_FUNC(op_neg_d,     COP1_D_OP(0x07));
+        REG_OP_FUNC(op_trunc_w_d, COP1_D_OP(0x0D));
+        REG_OP_FUNC(op_cvt_s_d,   COP1_D_OP(0x20));
+        REG_OP_FUNC(op_cvt_w_d,   COP1_D_OP(0x24));
+
+        // c.cond.fmt: the low four bits of the function are the condition
+        for (int cond = 0; cond < 16; ++cond)
+        {
+            REG_OP_FUNC(op_c_s,   COP1_S_OP(0x30 + cond));
+            REG_OP_FUNC(op_c_d,   COP1_D_OP(0x30 + cond));
+        }
+
+        REG_OP_FUNC(op_cvt_s_w,   COP1_W_OP(0x20));
+        REG_OP_FUNC(op_cvt_d_w,   COP1_W_OP(0x21));
+
+        REG_OP_FUNC(op_slt,     SPECIAL_OP(0x2A));
+        REG_OP_FUNC(op_sltu,    SPECIAL_OP(0x2B));
+        REG_OP_FUNC(op_slti,    0x0A);
+        REG_OP_FUNC(op_sltiu,   0x0B);
+    }
+
+    const MipsCPU::OpcodeTable MipsCPU::_opcodes;
+
+    /**
+     * @brief Breakpoints as one bitmap per page that has any, and watchpoints.
+     */
+    struct MipsCPU::DebugState
+    {
+        typedef std::bitset<(1 << (Memory::page_shift - 2))> PageBits;
+
+        DebugState() : breakpointCount(0), resumePC(no_block), stop(debug_none), watchAddress(0), watchHit(0) {}
+
+        boost::unordered_map<boost::uint32_t, PageBits> breakpoints;
+        size_t breakpointCount;
+        std::vector< std::pair<boost::uint32_t, boost::uint32_t> > watchpoints;
+
+        // the breakpoint at the PC execution resumes from is not hit again
+        boost::uint32_t resumePC;
+        DebugStop stop;
+        boost::uint32_t watchAddress;
+        // written by whichever core hit the watchpoint, see watchTriggered
+        boost::atomic<boost::uint32_t> watchHit;
+    };
+
+    /**
+     * @brief The COP0 registers that exist besides Cause, and where 
+     * exceptions go.
+     */
+    struct MipsCPU::Cop0
+    {
+        Cop0() 
+            : status(0), epc(0), badVAddr(0), countBase(0), compare(0), base(default_exception_base), 
+              fetchTarget(0), timerExact(false) 
+        {}
+
+        boost::uint32_t status, epc, badVAddr;
+        // Count is countBase plus the retired instructions, nothing ticks
+        boost::uint32_t countBase, compare;
+        boost::uint32_t base;
+        // the unaligned target the PC is about to be fetched from, see badFetch
+        boost::uint32_t fetchTarget;
+        // set while a deferred timer access runs, see completeTimerAccess
+        bool timerExact;
+    };
+
+    const boost::uint32_t MipsCPU::event_interrupt_mask;
+    const boost::uint32_t MipsCPU::event_watch;
+    const boost::uint32_t MipsCPU::event_stop;
+
+    MipsCPU::MipsCPU()
+        : _HI(0), _LO(0), _PC(0), _nPC(4), _FCSR(0), 
+          _llAddr(0), _llValue(0), _llValid(false), _stall(0), _instrumented(false), _cause(0), _storeBuffer(0),
+          _events(0), _interruptLines(0), _instructions(0), _timerDeadline(timer_period), 
+          _nextSequential(no_block), _blockStart(0)
+    {
+        std::memset(_GPR, 0, sizeof(_GPR));
+        std::memset(_FPR, 0, sizeof(_FPR));
+        std::memset(_FCR, 0, sizeof(_FCR));
+        _FCR[0] = fir_value;
+    }
+
+    MipsCPU::~MipsCPU()
+    {
+        if (_debug) disarmDebugState();
     }
 
     void MipsCPU::reset()
     {
-        for ( int i = 0; i < gpr_count; ++i ) _GPR[i] = 0;
-        for ( int i = 0; i < fpr_count; ++i ) _FPR[i] = 0;
-        for ( int i = 0; i < fcr_count; ++i ) _FCR[i] = 0;
+        std::memset(_GPR, 0, sizeof(_GPR));
+        std::memset(_FPR, 0, sizeof(_FPR));
+        std::memset(_FCR, 0, sizeof(_FCR));
+        _FCR[0] = fir_value;
         _HI = _LO = _FCSR = 0;
-        _nPC = _PC = 4;
+        _PC = 0;
+        _nPC = 4;
+        _llValid = false;
+        _stall = 0;
+        _events.store(0, boost::memory_order_relaxed);
+        _interruptLines = 0;
+        _instructions = 0;
+        _timerDeadline = timer_period;
+        _nextSequential = no_block;
+        _blockStart = 0;
+        _cause = 0;
+
+        if (_cop0)
+        {
+            boost::uint32_t base = _cop0->base;
+            *_cop0 = Cop0();
+            _cop0->base = base;
+        }
     }
 
     /**
@@ -97,28 +419,12 @@ namespace tememu
      */
     void MipsCPU::runDecodedInstr(int32 instr)
     {
-        int32 opcode = (instr & 0x03fffffff) >> 26;
-        int32 internal_opcode = 0, func = 0; 
-
-        if (opcode == 0)
-        {
-            func = instr & 0x0000003F;
-            internal_opcode = func << 4;
-        }
-        else
-        {
-            internal_opcode = opcode; 
-        }
-
-#if defined(DEBUG) && defined(TRACE_OPCODES)
-        std::cout << _opNameMap[internal_opcode] << "\n";
-#endif
-
-        boost::unordered_map<int32, OpcodeFn>::iterator it = _fnMap.find(internal_opcode);
+        int32 internal_opcode = internalOpcode(instr);
+        OpcodeFn fn = _opcodes.handlers[internal_opcode];
 
-        if (it != _fnMap.end())
+        if (fn)
         {
-            CALL_MEMBER(this, it->second)(instr);
+            CALL_MEMBER(this, fn)(instr);
         }
         else
         {
@@ -129,15 +435,46 @@ namespace tememu
         }
     }
 
+    int MipsCPU::internalOpcode(int32 instr)
+    {
+        int32 opcode = OPCODE(instr);
+        if (opcode == 0) return SPECIAL_OP(FUNCT(instr));
+        if (opcode == 0x1C) return SPECIAL2_OP(FUNCT(instr));
+        if (opcode == 0x11)
+        {
+            switch (FMT(instr))
+            {
+            case 0x10: return COP1_S_OP(FUNCT(instr));
+            case 0x11: return COP1_D_OP(FUNCT(instr));
+            case 0x14: return COP1_W_OP(FUNCT(instr));
+            default: return COP1_OP(FMT(instr));
+            }
+        }
+        return opcode;
+    }
+
+    const char* MipsCPU::opcodeName(int internalOpcode)
+    {
+        return _opcodes.names[internalOpcode];
+    }
+
     void MipsCPU::advance_pc(int32 offset)
     {
         _PC = _nPC;
         _nPC += offset;
     }
 
+    // add, addi and sub trap on signed overflow and leave the destination alone
     void MipsCPU::op_add(int32 instr)
     {
-        _GPR[RD(instr)] = _GPR[RS(instr)] + _GPR[RT(instr)];
+        int32 result;
+        if (BOOST_UNLIKELY(addOverflows(_GPR[RS(instr)], _GPR[RT(instr)], result)))
+        {
+            raiseException(exc_overflow);
+            return;
+        }
+
+        _GPR[RD(instr)] = result;
         step();
     }
 
@@ -152,7 +489,14 @@ namespace tememu
         int_short conv;
         conv.i = instr;
 
-        _GPR[RT(instr)] = _GPR[RS(instr)] + conv.s;
+        int32 result;
+        if (BOOST_UNLIKELY(addOverflows(_GPR[RS(instr)], conv.s, result)))
+        {
+            raiseException(exc_overflow);
+            return;
+        }
+
+        _GPR[RT(instr)] = result;
         step();
     }
 
@@ -167,7 +511,14 @@ namespace tememu
 
     void MipsCPU::op_sub(int32 instr)
     {
-        _GPR[RD(instr)] = _GPR[RS(instr)] - _GPR[RT(instr)];
+        int32 result;
+        if (BOOST_UNLIKELY(subOverflows(_GPR[RS(instr)], _GPR[RT(instr)], result)))
+        {
+            raiseException(exc_overflow);
+            return;
+        }
+
+        _GPR[RD(instr)] = result;
         step();
     }
 
@@ -177,32 +528,120 @@ namespace tememu
         step();
     }
 
+    /**
+     * @brief HI and LO as one 64 bit value, HI in the upper half.
+     */
+    boost::uint64_t MipsCPU::hiLo() const
+    {
+        return (boost::uint64_t(boost::uint32_t(_HI)) << 32) | boost::uint32_t(_LO);
+    }
+
+    void MipsCPU::setHiLo(boost::uint64_t value)
+    {
+        _LO = int32(value);
+        _HI = int32(value >> 32);
+    }
+
+    // the multiplies are a single 64 bit host multiply each
     void MipsCPU::op_mult(int32 instr)
     {
-        _LO = ((_GPR[RT(instr)] * _GPR[RS(instr)]) << 16) >> 16;
-        _HI = (_GPR[RT(instr)] * _GPR[RS(instr)]) << 16;
+        setHiLo(boost::int64_t(_GPR[RS(instr)]) * _GPR[RT(instr)]);
+        step();
+    }
+
+    void MipsCPU::op_multu(int32 instr)
+    {
+        setHiLo(boost::uint64_t(boost::uint32_t(_GPR[RS(instr)])) * boost::uint32_t(_GPR[RT(instr)]));
+        step();
+    }
+
+    void MipsCPU::op_madd(int32 instr)
+    {
+        setHiLo(hiLo() + boost::int64_t(_GPR[RS(instr)]) * _GPR[RT(instr)]);
+        step();
+    }
+
+    void MipsCPU::op_maddu(int32 instr)
+    {
+        setHiLo(hiLo() + boost::uint64_t(boost::uint32_t(_GPR[RS(instr)])) * boost::uint32_t(_GPR[RT(instr)]));
+        step();
+    }
+
+    void MipsCPU::op_msub(int32 instr)
+    {
+        setHiLo(hiLo() - boost::int64_t(_GPR[RS(instr)]) * _GPR[RT(instr)]);
+        step();
+    }
+
+    void MipsCPU::op_msubu(int32 instr)
+    {
+        setHiLo(hiLo() - boost::uint64_t(boost::uint32_t(_GPR[RS(instr)])) * boost::uint32_t(_GPR[RT(instr)]));
+        step();
+    }
+
+    // the low word of the product goes to rd; HI and LO are left alone
+    void MipsCPU::op_mul(int32 instr)
+    {
+        _GPR[RD(instr)] = int32(boost::uint32_t(_GPR[RS(instr)]) * boost::uint32_t(_GPR[RT(instr)]));
         step();
     }
 
+    /**
+     * @brief Signed division; the quotient goes to LO and the remainder to HI.
+     *
+     * The results of dividing by zero are unpredictable on MIPS and 
+     * INT_MIN / -1 overflows; both would raise SIGFPE on the host, so they
+     * are guarded with one unlikely branch. They give LO = -1 (1 for a 
+     * negative dividend) and HI = dividend for zero, and LO = INT_MIN, 
+     * HI = 0 for the overflow. The quotient and the remainder of the same
+     * operands come from a single host divide.
+     */
     void MipsCPU::op_div(int32 instr)
     {
-        _LO = _GPR[RS(instr)] / _GPR[RT(instr)];
-        _HI = _GPR[RS(instr)] % _GPR[RT(instr)];
+        int32 n = _GPR[RS(instr)], d = _GPR[RT(instr)];
+
+        if (BOOST_UNLIKELY(d == 0 || (d == -1 && n == INT_MIN)))
+        {
+            _LO = d == 0 ? (n < 0 ? 1 : -1) : INT_MIN;
+            _HI = d == 0 ? n : 0;
+        }
+        else
+        {
+            _LO = n / d;
+            _HI = n % d;
+        }
         step();
     }
 
     void MipsCPU::op_divu(int32 instr)
     {
-        _LO = _GPR[RS(instr)] / _GPR[RT(instr)];
-        _HI = _GPR[RS(instr)] % _GPR[RT(instr)];
+        boost::uint32_t n = _GPR[RS(instr)], d = _GPR[RT(instr)];
+
+        if (BOOST_UNLIKELY(d == 0))
+        {
+            _LO = -1;
+            _HI = n;
+        }
+        else
+        {
+            _LO = n / d;
+            _HI = n % d;
+        }
         step();
     }
 
+    /*
+     * Branches and jumps only change _nPC: the instruction in the delay slot
+     * runs next, then the target. Branch offsets count from the delay slot.
+     */
     void MipsCPU::op_beq(int32 instr)
     {
+        int_short conv;
+        conv.i = instr;
+
         if (_GPR[RS(instr)] == _GPR[RT(instr)])
         {
-            advance_pc(4 + 4 * IMMEDIATE(instr));
+            advance_pc(conv.s * 4);
         }
         else
         {
@@ -217,7 +656,7 @@ namespace tememu
 
         if (_GPR[RS(instr)] != _GPR[RT(instr)])
         {
-            advance_pc(4 + conv.s * 4);
+            advance_pc(conv.s * 4);
         }
         else
         {
@@ -228,20 +667,31 @@ namespace tememu
     void MipsCPU::op_j(int32 instr)
     {
         _PC = _nPC;
-        _nPC = (_PC & 0xf0000000) | ADDRESS(instr) + 4;
+        _nPC = (_PC & 0xf0000000) | ADDRESS(instr);
     }
 
     void MipsCPU::op_jal(int32 instr)
     {
-        _GPR[31] = _PC + 4; // return address is the next instruction from here
+        _GPR[31] = _nPC + 4; // return past the delay slot
         _PC = _nPC;
-        _nPC = (_PC & 0xf0000000) | ADDRESS(instr) + 4;
+        _nPC = (_PC & 0xf0000000) | ADDRESS(instr);
     }
 
     void MipsCPU::op_jr(int32 instr)
     {
+        boost::uint32_t target = _GPR[RS(instr)];
+
+        _PC = _nPC;
+        _nPC = BOOST_LIKELY(!(target & 3)) ? target : badFetch(target);
+    }
+
+    void MipsCPU::op_jalr(int32 instr)
+    {
+        boost::uint32_t target = _GPR[RS(instr)]; // read before rd is written
+
+        _GPR[RD(instr)] = _nPC + 4; // return past the delay slot
         _PC = _nPC;
-        _nPC = _GPR[RS(instr)] + 4;
+        _nPC = BOOST_LIKELY(!(target & 3)) ? target : badFetch(target);
     }
 
     void MipsCPU::op_mfhi(int32 instr)
@@ -268,66 +718,1372 @@ namespace tememu
         step();
     }
 
-    void MipsCPU::op_and(int32 instr)
+    /**
+     * @brief Calls the host call handler, or raises the Syscall exception
+     * if there is none. Which of the two happened is recorded, so a 
+     * replaying CPU does the same without a handler.
+     *
+     * The PC is advanced before the handler runs, so a blocked CPU resumes
+     * after the syscall once it is unblocked.
+     */
+    void MipsCPU::op_syscall(int32 /*instr*/)
     {
-        _GPR[RD(instr)] = _GPR[RS(instr)] & _GPR[RT(instr)];
+        if (_replayer)
+        {
+            replayHostCall();
+            return;
+        }
+
+        if (!_hostCall)
+        {
+            if (_recorder) _recorder->syscallException();
+            raiseException(exc_syscall);
+            return;
+        }
+
         step();
+        if (_recorder) _recorder->beginHostCall(_GPR);
+
+        if (!_hostCall(*this)) _stall |= stall_blocked;
+        else if (_recorder) _recorder->endHostCall(_GPR, _interruptLines);
     }
 
-    void MipsCPU::op_andi(int32 instr)
+    void MipsCPU::unblock()
     {
-        _GPR[RT(instr)] = _GPR[RS(instr)] & IMMEDIATE(instr);
-        step();
+        _stall &= ~stall_blocked;
+        if (_recorder) _recorder->endHostCall(_GPR, _interruptLines);
     }
 
-    void MipsCPU::op_or(int32 instr)
+    void MipsCPU::op_break(int32 /*instr*/)
     {
-        _GPR[RD(instr)] = _GPR[RS(instr)] | _GPR[RT(instr)];
-        step();
+        raiseException(exc_breakpoint);
     }
 
-    void MipsCPU::op_ori(int32 instr)
+    /**
+     * @brief mfc0, mtc0 and eret. COP0 instructions are rare, so they share
+     * one entry of the dispatch table.
+     */
+    void MipsCPU::op_cop0(int32 instr)
     {
-        _GPR[RT(instr)] = _GPR[RS(instr)] | IMMEDIATE(instr);
+        Cop0& state = cop0State();
+
+        switch (RS(instr))
+        {
+        case 0x00: // mfc0
+        case 0x04: // mtc0
+            // the instruction count is only exact between slices
+            if ((RD(instr) == cop0_count || RD(instr) == cop0_compare) && !state.timerExact)
+            {
+                _stall |= stall_timer;
+                return;
+            }
+            if (RS(instr) == 0x00) _GPR[RT(instr)] = cop0(RD(instr));
+            else setCop0(RD(instr), _GPR[RT(instr)]);
+            break;
+        case 0x10: // eret
+            if (FUNCT(instr) != 0x18) break;
+            state.status &= ~status_exl;
+            _llValid = false;
+            _stall |= stall_cop0;
+            setPC(state.epc & 3 ? badFetch(state.epc) : state.epc);
+            return;
+        }
         step();
     }
 
-    void MipsCPU::op_xor(int32 instr)
+    boost::uint32_t MipsCPU::cop0(int reg) const
     {
-        _GPR[RD(instr)] = _GPR[RS(instr)] ^ _GPR[RT(instr)];
-        step();
+        static const Cop0 reset_state;
+        const Cop0& cop0 = _cop0 ? *_cop0 : reset_state;
+
+        switch (reg)
+        {
+        case cop0_badvaddr: return cop0.badVAddr;
+        case cop0_count: return cop0.countBase + boost::uint32_t(_instructions);
+        case cop0_compare: return cop0.compare;
+        case cop0_status: return cop0.status;
+        // the hardware interrupt lines show up in IP2..IP7 
+        case cop0_cause: return _cause | ((_interruptLines << 8) & cause_ip);
+        case cop0_epc: return cop0.epc;
+        default: return 0;
+        }
     }
 
-    void MipsCPU::op_nor(int32 instr)
+    /**
+     * @brief Writes a COP0 register; writes to Status and Cause have the 
+     * run loop look at the pending interrupts before the next instruction.
+     * Writing Compare acknowledges the timer interrupt.
+     */
+    void MipsCPU::setCop0(int reg, boost::uint32_t value)
     {
-        _GPR[RD(instr)] = ~(_GPR[RS(instr)] | _GPR[RT(instr)]);
-        step();
+        if (reg == cop0_cause)
+        {
+            // only the software interrupt bits are writable
+            _cause = (_cause & ~cause_software) | (value & cause_software); 
+            _stall |= stall_cop0;
+            return;
+        }
+
+        Cop0& cop0 = cop0State();
+
+        switch (reg)
+        {
+        case cop0_count: 
+            cop0.countBase = value - boost::uint32_t(_instructions); 
+            updateTimerDeadline();
+            break;
+        case cop0_compare: 
+            cop0.compare = value; 
+            _cause &= ~cause_timer;
+            updateTimerDeadline();
+            break;
+        case cop0_status: 
+            cop0.status = value; 
+            _stall |= stall_cop0;
+            break;
+        case cop0_epc: cop0.epc = value; break;
+        }
     }
 
-    void MipsCPU::loadProgram(boost::shared_ptr< std::vector<int32> > program)
+    void MipsCPU::setExceptionBase(boost::uint32_t base)
     {
-        _program = program;
+        cop0State().base = base;
     }
 
-    void MipsCPU::runProgram()
+    MipsCPU::Cop0& MipsCPU::cop0State()
+    {
+        if (BOOST_UNLIKELY(!_cop0)) _cop0.reset(new Cop0);
+        return *_cop0;
+    }
+
+    /**
+     * @brief Turns Compare into the instruction count at which Count 
+     * reaches it. A match at the current count is a full period away.
+     */
+    void MipsCPU::updateTimerDeadline()
+    {
+        boost::uint32_t left = cop0(cop0_compare) - cop0(cop0_count);
+        _timerDeadline = _instructions + (left ? left : timer_period);
+    }
+
+    void MipsCPU::timerExpired()
+    {
+        _cause |= cause_timer;
+        _timerDeadline += timer_period;
+    }
+
+    /**
+     * @brief Takes a precise exception at the current instruction.
+     *
+     * Nothing of the faulting instruction has been done. EPC points at it
+     * (unless an exception is already being handled), Cause holds the 
+     * code and execution continues at the exception vector. If the vector
+     * is outside the program, the CPU halts there.
+     *
+     * In a delay slot EPC points at the branch, which runs again after 
+     * eret, and Cause.BD is set. A taken branch is what tells the slot 
+     * apart; resuming at a slot the branch fell through to is the same.
+     *
+     * The instruction does not retire: stall_exception ends the slice 
+     * before the observers are told about it.
+     */
+    void MipsCPU::raiseException(int code, boost::uint32_t badAddr)
+    {
+        Cop0& cop0 = cop0State();
+
+        if (code == exc_address_load || code == exc_address_store) cop0.badVAddr = badAddr;
+        if (!(cop0.status & status_exl)) 
+        {
+            bool delaySlot = boost::uint32_t(_nPC) != boost::uint32_t(_PC) + 4;
+            cop0.epc = delaySlot ? _PC - 4 : _PC;
+            _cause = delaySlot ? _cause | cause_bd : _cause & ~cause_bd;
+            cop0.status |= status_exl;
+        }
+        _cause = (_cause & ~cause_exc_code) | (code << 2);
+        setPC(cop0.base + exception_offset);
+        _stall |= stall_exception;
+    }
+
+    /**
+     * @brief Where jr, jalr and eret go instead of an unaligned target.
+     *
+     * The fetch from the target fails, not the jump, so the delay slot 
+     * still runs. The returned PC is past any text, which ends the slice 
+     * without a check in the run loop; execute then calls fetchFault.
+     */
+    boost::uint32_t MipsCPU::badFetch(boost::uint32_t target)
+    {
+        cop0State().fetchTarget = target;
+        return fetch_fault_pc;
+    }
+
+    /**
+     * @brief Raises the address error of the fetch from the unaligned 
+     * target, with EPC and BadVAddr pointing at it. Like any exception it
+     * ends the slice.
+     */
+    void MipsCPU::fetchFault()
+    {
+        boost::uint32_t target = _cop0->fetchTarget;
+
+        setPC(target);
+        raiseException(exc_address_load, target);
+    }
+
+    /**
+     * @brief Takes the interrupt exception if a pending line is enabled.
+     */
+    void MipsCPU::takeInterrupt()
     {
-        size_t psize = _program->size();
+        if (!_cop0) return; // Status is still 0, interrupts are disabled
 
-        if (psize < 1) return;
+        const Cop0& cop0 = *_cop0;
+        boost::uint32_t pending = _cause | ((_interruptLines << 8) & cause_ip);
 
-        while (_nPC / 4 - 1 < psize)
-            runDecodedInstr(_program->at(_nPC / 4 - 1));
+        if ((cop0.status & (status_ie | status_exl)) == status_ie && (pending & cop0.status & cause_ip))
+        {
+            raiseException(exc_interrupt);
+            _stall &= ~stall_exception; // taken between two instructions
+        }
     }
 
-    void MipsCPU::stepProgram(int steps)
+    /**
+     * @brief Applies the next recorded host call result instead of calling 
+     * the host, or raises the exception the syscall raised when recorded.
+     */
+    void MipsCPU::replayHostCall()
     {
-        size_t psize = _program->size();
+        HostCallRecord record;
+        if (!_replayer->nextHostCall(record))
+            throw std::runtime_error("MipsCPU: replay diverged, no host call left in the log");
 
-        for (int i = 0; i < steps; ++i)
+        if (record.exception)
         {
-            runDecodedInstr(_program->at(_nPC / 4 - 1));
-            if (_nPC / 4 - 1 >= psize) break;
+            raiseException(exc_syscall);
+            return;
         }
+
+        step();
+
+        for (size_t i = 0; i < record.registers.size(); ++i)
+            _GPR[record.registers[i].first] = record.registers[i].second;
+
+        for (size_t i = 0; i < record.writes.size(); ++i)
+            writeWord(record.writes[i].first, record.writes[i].second);
+
+        _interruptLines = record.interruptLines;
+    }
+
+    void MipsCPU::writeGuestWord(boost::uint32_t addr, boost::uint32_t value)
+    {
+        writeWord(addr, value);
+        if (_recorder) _recorder->memoryWritten(addr, value);
+    }
+
+    /**
+     * @brief Computes base + sign extended offset for the load/store instructions.
+     */
+    boost::uint32_t MipsCPU::effectiveAddress(int32 instr) const
+    {
+        int_short conv;
+        conv.i = instr;
+
+        return _GPR[RS(instr)] + conv.s;
+    }
+
+    // unaligned word accesses raise address errors before touching anything
+    void MipsCPU::op_lw(int32 instr)
+    {
+        boost::uint32_t addr = effectiveAddress(instr);
+        if (BOOST_UNLIKELY(badAddress(addr))) return raiseException(exc_address_load, addr);
+
+        _GPR[RT(instr)] = readWord(addr);
+        step();
+    }
+
+    void MipsCPU::op_sw(int32 instr)
+    {
+        boost::uint32_t addr = effectiveAddress(instr);
+        if (BOOST_UNLIKELY(badAddress(addr))) return raiseException(exc_address_store, addr);
+
+        writeWord(addr, _GPR[RT(instr)]);
+        step();
+    }
+
+    /**
+     * @brief Load linked: loads the word and remembers it as the reservation.
+     */
+    void MipsCPU::op_ll(int32 instr)
+    {
+        boost::uint32_t addr = effectiveAddress(instr);
+        if (BOOST_UNLIKELY(badAddress(addr))) return raiseException(exc_address_load, addr);
+
+        _llAddr = addr;
+        _llValue = readWord(_llAddr);
+        _llValid = true;
+        _GPR[RT(instr)] = _llValue;
+        step();
+    }
+
+    /**
+     * @brief Store conditional on top of a host compare-and-swap.
+     *
+     * The store succeeds if the reservation is intact and the word still
+     * holds the value LL observed. Like every CAS based LL/SC this cannot
+     * see an A-B-A sequence of writes by other cores, which is harmless for
+     * the usual lock and counter idioms.
+     */
+    void MipsCPU::op_sc(int32 instr)
+    {
+        boost::uint32_t addr = effectiveAddress(instr);
+        if (BOOST_UNLIKELY(badAddress(addr))) return raiseException(exc_address_store, addr);
+
+        if (_storeBuffer) 
+        {
+            _stall |= stall_sync;
+            return;
+        }
+
+        bool success = _llValid && _llAddr == addr &&
+            _memory->compareAndSwap(addr, _llValue, _GPR[RT(instr)]);
+        takeWatchHit();
+
+        _llValid = false;
+        _GPR[RT(instr)] = success ? 1 : 0;
+        step();
+    }
+
+    void MipsCPU::op_sync(int32 /*instr*/)
+    {
+        if (_storeBuffer) 
+        {
+            _stall |= stall_sync;
+            return;
+        }
+
+        Memory::fence();
+        step();
+    }
+
+    void MipsCPU::op_and(int32 instr)
+    {
+        _GPR[RD(instr)] = _GPR[RS(instr)] & _GPR[RT(instr)];
+        step();
+    }
+
+    void MipsCPU::op_andi(int32 instr)
+    {
+        _GPR[RT(instr)] = _GPR[RS(instr)] & IMMEDIATE(instr);
+        step();
+    }
+
+    void MipsCPU::op_or(int32 instr)
+    {
+        _GPR[RD(instr)] = _GPR[RS(instr)] | _GPR[RT(instr)];
+        step();
+    }
+
+    void MipsCPU::op_ori(int32 instr)
+    {
+        _GPR[RT(instr)] = _GPR[RS(instr)] | IMMEDIATE(instr);
+        step();
+    }
+
+    void MipsCPU::op_xor(int32 instr)
+    {
+        _GPR[RD(instr)] = _GPR[RS(instr)] ^ _GPR[RT(instr)];
+        step();
+    }
+
+    void MipsCPU::op_nor(int32 instr)
+    {
+        _GPR[RD(instr)] = ~(_GPR[RS(instr)] | _GPR[RT(instr)]);
+        step();
+    }
+
+    // shifts: variable amounts use the low five bits of rs; sra relies on 
+    // >> of a negative int32 being arithmetic, as it is on every host we support
+    void MipsCPU::op_sll(int32 instr)
+    {
+        _GPR[RD(instr)] = boost::uint32_t(_GPR[RT(instr)]) << SHAMT(instr);
+        step();
+    }
+
+    void MipsCPU::op_srl(int32 instr)
+    {
+        _GPR[RD(instr)] = boost::uint32_t(_GPR[RT(instr)]) >> SHAMT(instr);
+        step();
+    }
+
+    void MipsCPU::op_sra(int32 instr)
+    {
+        _GPR[RD(instr)] = _GPR[RT(instr)] >> SHAMT(instr);
+        step();
+    }
+
+    void MipsCPU::op_sllv(int32 instr)
+    {
+        _GPR[RD(instr)] = boost::uint32_t(_GPR[RT(instr)]) << (_GPR[RS(instr)] & 31);
+        step();
+    }
+
+    void MipsCPU::op_srlv(int32 instr)
+    {
+        _GPR[RD(instr)] = boost::uint32_t(_GPR[RT(instr)]) >> (_GPR[RS(instr)] & 31);
+        step();
+    }
+
+    void MipsCPU::op_srav(int32 instr)
+    {
+        _GPR[RD(instr)] = _GPR[RT(instr)] >> (_GPR[RS(instr)] & 31);
+        step();
+    }
+
+    // comparisons compile to a compare and a setcc, without branches
+    void MipsCPU::op_slt(int32 instr)
+    {
+        _GPR[RD(instr)] = _GPR[RS(instr)] < _GPR[RT(instr)];
+        step();
+    }
+
+    void MipsCPU::op_sltu(int32 instr)
+    {
+        _GPR[RD(instr)] = boost::uint32_t(_GPR[RS(instr)]) < boost::uint32_t(_GPR[RT(instr)]);
+        step();
+    }
+
+    void MipsCPU::op_slti(int32 instr)
+    {
+        int_short conv;
+        conv.i = instr;
+
+        _GPR[RT(instr)] = _GPR[RS(instr)] < conv.s;
+        step();
+    }
+
+    // the immediate is sign extended, then compared unsigned
+    void MipsCPU::op_sltiu(int32 instr)
+    {
+        int_short conv;
+        conv.i = instr;
+
+        _GPR[RT(instr)] = boost::uint32_t(_GPR[RS(instr)]) < boost::uint32_t(int32(conv.s));
+        step();
+    }
+
+    /*
+     * The FPU. Registers hold raw words; a double is in an even/odd pair
+     * with the low word in the even register (FR = 0).
+     */
+    float MipsCPU::fprSingle(int index) const
+    {
+        float value;
+        std::memcpy(&value, &_FPR[index], sizeof(value));
+        return value;
+    }
+
+    void MipsCPU::setFprSingle(int index, float value)
+    {
+        std::memcpy(&_FPR[index], &value, sizeof(value));
+    }
+
+    double MipsCPU::fprDouble(int index) const
+    {
+        boost::uint64_t bits = boost::uint32_t(_FPR[index & ~1]) | (boost::uint64_t(boost::uint32_t(_FPR[index | 1])) << 32);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    void MipsCPU::setFprDouble(int index, double value)
+    {
+        boost::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        _FPR[index & ~1] = int32(bits);
+        _FPR[index | 1] = int32(bits >> 32);
+    }
+
+    // condition code 0 is FCSR bit 23, codes 1..7 are bits 25..31
+    bool MipsCPU::fpuCondition(int cc) const
+    {
+        return (_FCSR >> (cc ? 24 + cc : 23)) & 1;
+    }
+
+    void MipsCPU::setFpuCondition(int cc, bool value)
+    {
+        boost::uint32_t bit = 1u << (cc ? 24 + cc : 23);
+        _FCSR = value ? _FCSR | bit : _FCSR & ~bit;
+    }
+
+    void MipsCPU::op_mfc1(int32 instr)
+    {
+        _GPR[RT(instr)] = _FPR[FPR_S(instr)];
+        step();
+    }
+
+    void MipsCPU::op_mtc1(int32 instr)
+    {
+        _FPR[FPR_S(instr)] = _GPR[RT(instr)];
+        step();
+    }
+
+    // only FIR (0) and FCSR (31) are implemented; the others read as zero
+    void MipsCPU::op_cfc1(int32 instr)
+    {
+        int fs = FPR_S(instr);
+        _GPR[RT(instr)] = fs == 31 ? _FCSR : fs == 0 ? _FCR[0] : 0;
+        step();
+    }
+
+    void MipsCPU::op_ctc1(int32 instr)
+    {
+        if (FPR_S(instr) == 31)
+        {
+            boost::uint32_t old = _FCSR;
+            _FCSR = _GPR[RT(instr)];
+#if defined(__SSE2__)
+            if ((old ^ _FCSR) & fcsr_mode) _mm_setcsr(guestMxcsr(_mm_getcsr(), _FCSR));
+#else
+            (void)old;
+#endif
+        }
+        step();
+    }
+
+    // bc1f and bc1t: bit 16 is the value to branch on, bits 18..20 the condition code
+    void MipsCPU::op_bc1(int32 instr)
+    {
+        int_short conv;
+        conv.i = instr;
+
+        if (fpuCondition((instr >> 18) & 7) == bool(instr & 0x10000))
+        {
+            advance_pc(conv.s * 4);
+        }
+        else
+        {
+            step();
+        }
+    }
+
+    void MipsCPU::op_lwc1(int32 instr)
+    {
+        boost::uint32_t addr = effectiveAddress(instr);
+        if (BOOST_UNLIKELY(badAddress(addr))) return raiseException(exc_address_load, addr);
+
+        _FPR[FPR_T(instr)] = readWord(addr);
+        step();
+    }
+
+    void MipsCPU::op_swc1(int32 instr)
+    {
+        boost::uint32_t addr = effectiveAddress(instr);
+        if (BOOST_UNLIKELY(badAddress(addr))) return raiseException(exc_address_store, addr);
+
+        writeWord(addr, _FPR[FPR_T(instr)]);
+        step();
+    }
+
+    void MipsCPU::op_add_s(int32 instr)
+    {
+        setFprSingle(FPR_D(instr), fprSingle(FPR_S(instr)) + fprSingle(FPR_T(instr)));
+        step();
+    }
+
+    void MipsCPU::op_sub_s(int32 instr)
+    {
+        setFprSingle(FPR_D(instr), fprSingle(FPR_S(instr)) - fprSingle(FPR_T(instr)));
+        step();
+    }
+
+    void MipsCPU::op_mul_s(int32 instr)
+    {
+        setFprSingle(FPR_D(instr), fprSingle(FPR_S(instr)) * fprSingle(FPR_T(instr)));
+        step();
+    }
+
+    void MipsCPU::op_div_s(int32 instr)
+    {
+        setFprSingle(FPR_D(instr), fprSingle(FPR_S(instr)) / fprSingle(FPR_T(instr)));
+        step();
+    }
+
+    void MipsCPU::op_sqrt_s(int32 instr)
+    {
+#if defined(__SSE2__)
+        setFprSingle(FPR_D(instr), _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(fprSingle(FPR_S(instr))))));
+#else
+        setFprSingle(FPR_D(instr), std::sqrt(fprSingle(FPR_S(instr))));
+#endif
+        step();
+    }
+
+    // abs and neg only change the sign bit
+    void MipsCPU::op_abs_s(int32 instr)
+    {
+        _FPR[FPR_D(instr)] = _FPR[FPR_S(instr)] & 0x7FFFFFFF;
+        step();
+    }
+
+    void MipsCPU::op_mov_s(int32 instr)
+    {
+        _FPR[FPR_D(instr)] = _FPR[FPR_S(instr)];
+        step();
+    }
+
+    void MipsCPU::op_neg_s(int32 instr)
+    {
+        _FPR[FPR_D(instr)] = _FPR[FPR_S(instr)] ^ INT_MIN;
+        step();
+    }
+
+    void MipsCPU::op_trunc_w_s(int32 instr)
+    {
+        _FPR[FPR_D(instr)] = toWord(fprSingle(FPR_S(instr)), true);
+        step();
+    }
+
+    void MipsCPU::op_cvt_d_s(int32 instr)
+    {
+        setFprDouble(FPR_D(instr), fprSingle(FPR_S(instr)));
+        step();
+    }
+
+    // rounds according to FCSR, through MXCSR
+    void MipsCPU::op_cvt_w_s(int32 instr)
+    {
+        _FPR[FPR_D(instr)] = toWord(fprSingle(FPR_S(instr)), false);
+        step();
+    }
+
+    /**
+     * @brief c.cond.s: bits 0..2 of the condition select unordered, equal
+     * and less than; bits 8..10 of the instruction are the condition code.
+     */
+    void MipsCPU::op_c_s(int32 instr)
+    {
+        float a = fprSingle(FPR_S(instr)), b = fprSingle(FPR_T(instr));
+        int cond = FUNCT(instr);
+
+        bool unordered = a != a || b != b;
+        setFpuCondition((instr >> 8) & 7, 
+            ((cond & 4) && a < b) || ((cond & 2) && a == b) || ((cond & 1) && unordered));
+        step();
+    }
+
+    void MipsCPU::op_add_d(int32 instr)
+    {
+        setFprDouble(FPR_D(instr), fprDouble(FPR_S(instr)) + fprDouble(FPR_T(instr)));
+        step();
+    }
+
+    void MipsCPU::op_sub_d(int32 instr)
+    {
+        setFprDouble(FPR_D(instr), fprDouble(FPR_S(instr)) - fprDouble(FPR_T(instr)));
+        step();
+    }
+
+    void MipsCPU::op_mul_d(int32 instr)
+    {
+        setFprDouble(FPR_D(instr), fprDouble(FPR_S(instr)) * fprDouble(FPR_T(instr)));
+        step();
+    }
+
+    void MipsCPU::op_div_d(int32 instr)
+    {
+        setFprDouble(FPR_D(instr), fprDouble(FPR_S(instr)) / fprDouble(FPR_T(instr)));
+        step();
+    }
+
+    void MipsCPU::op_sqrt_d(int32 instr)
+    {
+#if defined(__SSE2__)
+        __m128d value = _mm_set_sd(fprDouble(FPR_S(instr)));
+        setFprDouble(FPR_D(instr), _mm_cvtsd_f64(_mm_sqrt_sd(value, value)));
+#else
+        setFprDouble(FPR_D(instr), std::sqrt(fprDouble(FPR_S(instr))));
+#endif
+        step();
+    }
+
+    void MipsCPU::op_abs_d(int32 instr)
+    {
+        int fd = FPR_D(instr) & ~1, fs = FPR_S(instr) & ~1;
+        _FPR[fd] = _FPR[fs];
+        _FPR[fd + 1] = _FPR[fs + 1] & 0x7FFFFFFF;
+        step();
+    }
+
+    void MipsCPU::op_mov_d(int32 instr)
+    {
+        int fd = FPR_D(instr) & ~1, fs = FPR_S(instr) & ~1;
+        _FPR[fd] = _FPR[fs];
+        _FPR[fd + 1] = _FPR[fs + 1];
+        step();
+    }
+
+    void MipsCPU::op_neg_d(int32 instr)
+    {
+        int fd = FPR_D(instr) & ~1, fs = FPR_S(instr) & ~1;
+        _FPR[fd] = _FPR[fs];
+        _FPR[fd + 1] = _FPR[fs + 1] ^ INT_MIN;
+        step();
+    }
+
+    void MipsCPU::op_trunc_w_d(int32 instr)
+    {
+        _FPR[FPR_D(instr)] = toWord(fprDouble(FPR_S(instr)), true);
+        step();
+    }
+
+    void MipsCPU::op_cvt_s_d(int32 instr)
+    {
+        setFprSingle(FPR_D(instr), float(fprDouble(FPR_S(instr))));
+        step();
+    }
+
+    void MipsCPU::op_cvt_w_d(int32 instr)
+    {
+        _FPR[FPR_D(instr)] = toWord(fprDouble(FPR_S(instr)), false);
+        step();
+    }
+
+    void MipsCPU::op_c_d(int32 instr)
+    {
+        double a = fprDouble(FPR_S(instr)), b = fprDouble(FPR_T(instr));
+        int cond = FUNCT(instr);
+
+        bool unordered = a != a || b != b;
+        setFpuCondition((instr >> 8) & 7, 
+            ((cond & 4) && a < b) || ((cond & 2) && a == b) || ((cond & 1) && unordered));
+        step();
+    }
+
+    void MipsCPU::op_cvt_s_w(int32 instr)
+    {
+        setFprSingle(FPR_D(instr), float(_FPR[FPR_S(instr)]));
+        step();
+    }
+
+    void MipsCPU::op_cvt_d_w(int32 instr)
+    {
+        setFprDouble(FPR_D(instr), double(_FPR[FPR_S(instr)]));
+        step();
+    }
+
+    /**
+     * @brief Loads the program into a new private memory.
+     *
+     * The memory holds the program text followed by default_data_size bytes
+     * of data. Use attachMemory to run cores on a shared memory instead.
+     */
+    void MipsCPU::loadProgram(boost::shared_ptr< std::vector<int32> > program)
+    {
+        if (_debug) disarmDebugState();
+        _memory.reset(new Memory(program->size() * sizeof(int32) + default_data_size));
+        _memory->loadProgram(*program);
+        if (_debug) armDebugState();
+    }
+
+    void MipsCPU::attachMemory(boost::shared_ptr<Memory> memory)
+    {
+        if (_debug) disarmDebugState();
+        _memory = memory;
+        if (_debug) armDebugState();
+    }
+
+    /**
+     * @brief True if the PC left the program text (or nothing is loaded).
+     */
+    bool MipsCPU::halted() const
+    {
+        return !_memory || boost::uint32_t(_PC) >= _memory->textEnd();
+    }
+
+    void MipsCPU::runProgram()
+    {
+        if (!_memory) return;
+
+        while (execute(INT_MAX) == INT_MAX);
+    }
+
+    /**
+     * @brief Executes at most steps instructions.
+     *
+     * Stops early when the PC leaves the text, the CPU blocks on a host call,
+     * a stop is requested or a breakpoint or watchpoint is hit.
+     *
+     * @return The number of instructions executed.
+     */
+    int MipsCPU::stepProgram(int steps)
+    {
+        if (!_memory) return 0;
+
+        return execute(steps);
+    }
+
+    /**
+     * @brief The run loop. 
+     *
+     * Instructions are executed in slices of event_poll_interval; the
+     * pending event word is only looked at between slices, so posting 
+     * events costs the running CPU nothing until one actually arrives.
+     *
+     * @return The number of instructions executed; less than budget if 
+     * the loop stopped early.
+     */
+    int MipsCPU::execute(int budget)
+    {
+        boost::uint32_t textEnd = _memory->textEnd();
+        int retired = 0;
+        GuestRounding rounding(_FCSR);
+
+        if (_debug)
+        {
+            _stall &= ~stall_break;
+            _debug->stop = debug_none;
+            _debug->resumePC = pc();
+            // writes while the CPU was stopped, e.g. by a debugger, do not stop it
+            _events.fetch_and(~event_watch, boost::memory_order_relaxed);
+        }
+
+        while (retired < budget)
+        {
+            // in deterministic mode events are delivered at the barriers
+            if (!_storeBuffer && _events.load(boost::memory_order_relaxed) && pollEvents()) break;
+
+            int slice = std::min(budget - retired, event_poll_interval);
+
+            // a replayed interrupt arrives exactly between two slices
+            if (_replayer)
+            {
+                deliverReplayedInterrupts();
+                slice = static_cast<int>(std::min<boost::uint64_t>(slice, _replayer->nextInterrupt() - _instructions));
+            }
+
+            // a slice ends where Count reaches Compare
+            slice = static_cast<int>(std::min<boost::uint64_t>(slice, _timerDeadline - _instructions));
+
+            if (BOOST_UNLIKELY(_interruptLines | (_cause & (cause_software | cause_timer)))) takeInterrupt();
+
+            int i;
+            if (_debug && _debug->breakpointCount)
+                i = _instrumented ? runSlice<true, true>(slice, textEnd) : runSlice<false, true>(slice, textEnd);
+            else
+                i = _instrumented ? runSlice<true, false>(slice, textEnd) : runSlice<false, false>(slice, textEnd);
+
+            retired += i;
+            _instructions += i;
+            if (BOOST_UNLIKELY(_instructions >= _timerDeadline)) timerExpired();
+            // the delay slot of a jump to an unaligned target has run
+            if (BOOST_UNLIKELY(boost::uint32_t(_PC) == fetch_fault_pc)) fetchFault();
+
+            // COP0 changes that may unmask an interrupt end the slice early,
+            // and so do Count and Compare accesses and exceptions
+            if (BOOST_UNLIKELY(_stall & (stall_cop0 | stall_timer | stall_exception)))
+            {
+                if (_stall & stall_timer) completeTimerAccess();
+                _stall &= ~(stall_cop0 | stall_exception);
+                continue;
+            }
+            if (i < slice) break;
+        }
+
+        return retired;
+    }
+
+    /**
+     * @brief Executes the sc or sync the CPU stopped at, directly on the 
+     * shared memory. Called at the barrier, after the store buffers of 
+     * every core have been committed.
+     */
+    void MipsCPU::completeSyncPoint()
+    {
+        StoreBuffer* buffer = _storeBuffer;
+
+        boost::uint32_t pc = _PC;
+        int32 instr = _memory->readWord(pc);
+
+        _stall &= ~stall_sync;
+        _storeBuffer = 0;
+
+        // the slice already counted it
+        if (_hooks) runHooked(pc, instr);
+        else runDecodedInstr(instr);
+        if (_instrumented) retired(pc, instr);
+        // sc or sync in the delay slot of a jump to an unaligned target
+        if (BOOST_UNLIKELY(boost::uint32_t(_PC) == fetch_fault_pc)) fetchFault();
+
+        _storeBuffer = buffer;
+    }
+
+    /**
+     * @brief Executes the Count or Compare access the slice stopped at, now
+     * that the instruction count is up to date. The slice already counted it.
+     */
+    void MipsCPU::completeTimerAccess()
+    {
+        boost::uint32_t pc = _PC;
+        int32 instr = _memory->readWord(pc);
+
+        _stall &= ~stall_timer;
+        --_instructions;
+        _cop0->timerExact = true;
+
+        if (_hooks) runHooked(pc, instr);
+        else runDecodedInstr(instr);
+        if (_instrumented) retired(pc, instr);
+
+        _cop0->timerExact = false;
+        ++_instructions;
+    }
+
+    /**
+     * @brief Executes up to slice instructions.
+     *
+     * The instrumented version reports every retired instruction to 
+     * retired(); the plain one is what runs when no observer is enabled.
+     * The Breakpoints versions only run while breakpoints are set, and 
+     * only look them up in pages flagged to have some.
+     */
+    template <bool Instrumented, bool Breakpoints>
+    int MipsCPU::runSlice(int slice, boost::uint32_t textEnd)
+    {
+        int i = 0;
+
+        for (; i < slice; ++i)
+        {
+            boost::uint32_t pc = _PC;
+            if (pc >= textEnd || _stall) break;
+            if (Breakpoints && (_memory->pageFlags(pc) & Memory::page_breakpoints) && breakpointHit(pc)) break;
+
+            int32 instr = _memory->readWord(pc);
+            if (Instrumented && pc != _nextSequential) enterBlock(pc);
+
+            if (Instrumented && _hooks) runHooked(pc, instr);
+            else runDecodedInstr(instr);
+
+            // a deferred sc, sync or timer access has not retired yet, and 
+            // an instruction that raised an exception never does
+            if (Instrumented && !(_stall & (stall_sync | stall_timer | stall_exception))) retired(pc, instr);
+            if (Breakpoints) _debug->resumePC = no_block;
+        }
+
+        return i;
+    }
+
+    /**
+     * @brief Observes an executed instruction for the enabled features.
+     */
+    void MipsCPU::retired(boost::uint32_t pc, int32 instr)
+    {
+        _nextSequential = pc + 4;
+        if (_opcodeCounts) ++_opcodeCounts[internalOpcode(instr)];
+
+        if (_trace)
+        {
+            int reg = _trace->recordsRegisters() ? writtenRegister(instr) : no_register;
+            _trace->append(pc, instr, reg, reg == no_register ? 0 : _GPR[reg]);
+        }
+
+        if (_profiler) _profiler->retired(*this, pc, instr);
+        if (_hooks && _hooks->instructionRetired) _hooks->instructionRetired(pc, instr);
+    }
+
+    /**
+     * @brief Called by the instrumented loop when control reaches pc other
+     * than by falling through from the previous instruction.
+     */
+    void MipsCPU::enterBlock(boost::uint32_t pc)
+    {
+        if (_coverage) _coverage->edge(_blockStart, pc);
+        if (_hooks && _hooks->blockEntry) _hooks->blockEntry(pc);
+        _blockStart = pc;
+    }
+
+    /**
+     * @brief Executes one instruction and calls the memory and branch hooks.
+     *
+     * The handlers know nothing about hooks: the address and the stored 
+     * value are taken before the instruction runs, the loaded value and 
+     * the branch target after it.
+     */
+    void MipsCPU::runHooked(boost::uint32_t pc, int32 instr)
+    {
+        const Hooks& hooks = *_hooks;
+        boost::uint32_t addr = effectiveAddress(instr);
+        boost::uint32_t stored = OPCODE(instr) == 0x39 ? _FPR[RT(instr)] : _GPR[RT(instr)];
+
+        runDecodedInstr(instr);
+        // reported when completed, or not at all after an exception
+        if (_stall & (stall_sync | stall_timer | stall_exception)) return;
+
+        // unaligned or out of range accesses raised an address error instead
+        switch (badAddress(addr) ? 0 : OPCODE(instr))
+        {
+        case 0x23: case 0x30: // lw, ll
+            if (hooks.memoryRead) hooks.memoryRead(addr, _GPR[RT(instr)]);
+            break;
+        case 0x31: // lwc1
+            if (hooks.memoryRead) hooks.memoryRead(addr, _FPR[RT(instr)]);
+            break;
+        case 0x2B: case 0x39: // sw, swc1
+            if (hooks.memoryWrite) hooks.memoryWrite(addr, stored);
+            break;
+        case 0x38: // sc, only if it succeeded
+            if (hooks.memoryWrite && _GPR[RT(instr)]) hooks.memoryWrite(addr, stored);
+            break;
+        }
+
+        // control goes to _nPC after the delay slot
+        if (boost::uint32_t(_nPC) != pc + 8 && hooks.branchTaken && isBranch(instr)) 
+            hooks.branchTaken(pc, boost::uint32_t(_nPC) == fetch_fault_pc ? _cop0->fetchTarget : _nPC);
+    }
+
+    bool MipsCPU::breakpointHit(boost::uint32_t pc)
+    {
+        if (pc == _debug->resumePC || !hasBreakpoint(pc)) return false;
+
+        _stall |= stall_break;
+        _debug->stop = debug_breakpoint;
+        return true;
+    }
+
+    /**
+     * @brief Called by the memory before a watched word is written, on the
+     * thread of the core that writes it, so it only posts an event. 
+     */
+    void MipsCPU::watchTriggered(boost::uint32_t addr)
+    {
+        _debug->watchHit.store(addr, boost::memory_order_relaxed);
+        _events.fetch_or(event_watch, boost::memory_order_release);
+    }
+
+    void MipsCPU::watchStop()
+    {
+        _stall |= stall_break;
+        _debug->stop = debug_watchpoint;
+        _debug->watchAddress = _debug->watchHit.load(boost::memory_order_relaxed);
+    }
+
+    void MipsCPU::addBreakpoint(boost::uint32_t addr)
+    {
+        if (!_debug) _debug.reset(new DebugState);
+
+        DebugState::PageBits& bits = _debug->breakpoints[addr >> Memory::page_shift];
+        size_t bit = (addr >> 2) & (bits.size() - 1);
+        if (bits.test(bit)) return;
+
+        bits.set(bit);
+        ++_debug->breakpointCount;
+        if (_memory && _memory->contains(addr)) _memory->setPageFlag(addr, Memory::page_breakpoints, true);
+    }
+
+    void MipsCPU::removeBreakpoint(boost::uint32_t addr)
+    {
+        if (!hasBreakpoint(addr)) return;
+
+        boost::unordered_map<boost::uint32_t, DebugState::PageBits>::iterator page = 
+            _debug->breakpoints.find(addr >> Memory::page_shift);
+        page->second.reset((addr >> 2) & (page->second.size() - 1));
+        --_debug->breakpointCount;
+
+        if (page->second.none())
+        {
+            _debug->breakpoints.erase(page);
+            if (_memory && _memory->contains(addr)) _memory->setPageFlag(addr, Memory::page_breakpoints, false);
+        }
+    }
+
+    bool MipsCPU::hasBreakpoint(boost::uint32_t addr) const
+    {
+        if (!_debug) return false;
+
+        boost::unordered_map<boost::uint32_t, DebugState::PageBits>::const_iterator page = 
+            _debug->breakpoints.find(addr >> Memory::page_shift);
+        return page != _debug->breakpoints.end() && page->second.test((addr >> 2) & (page->second.size() - 1));
+    }
+
+    /**
+     * @brief Stops execution after writes to [addr, addr + length).
+     *
+     * Only pages holding a watched range take the slow path on writes.
+     * Writes by any core sharing the memory count. A store of this CPU 
+     * stops it right after the instruction, one of another core by the 
+     * next event poll; stores buffered in deterministic mode are only seen
+     * when committed, and stop the system at that barrier.
+     */
+    void MipsCPU::addWatchpoint(boost::uint32_t addr, boost::uint32_t length)
+    {
+        if (!_debug) _debug.reset(new DebugState);
+
+        _debug->watchpoints.push_back(std::make_pair(addr, length));
+        if (_memory) _memory->watch(this, addr, length, boost::bind(&MipsCPU::watchTriggered, this, _1));
+    }
+
+    void MipsCPU::removeWatchpoint(boost::uint32_t addr, boost::uint32_t length)
+    {
+        if (!_debug) return;
+
+        std::vector< std::pair<boost::uint32_t, boost::uint32_t> >& watchpoints = _debug->watchpoints;
+        std::vector< std::pair<boost::uint32_t, boost::uint32_t> >::iterator it = 
+            std::find(watchpoints.begin(), watchpoints.end(), std::make_pair(addr, length));
+        if (it == watchpoints.end()) return;
+
+        watchpoints.erase(it);
+        if (_memory) _memory->unwatch(this, addr, length);
+    }
+
+    MipsCPU::DebugStop MipsCPU::debugStop() const
+    {
+        return _debug ? _debug->stop : debug_none;
+    }
+
+    boost::uint32_t MipsCPU::watchAddress() const
+    {
+        return _debug ? _debug->watchAddress : 0;
+    }
+
+    /**
+     * @brief Flags the pages of a newly attached memory for the existing
+     * breakpoints and watchpoints.
+     */
+    void MipsCPU::armDebugState()
+    {
+        if (!_memory) return;
+
+        for (boost::unordered_map<boost::uint32_t, DebugState::PageBits>::const_iterator page = _debug->breakpoints.begin();
+             page != _debug->breakpoints.end(); ++page)
+        {
+            boost::uint32_t addr = page->first << Memory::page_shift;
+            if (_memory->contains(addr)) _memory->setPageFlag(addr, Memory::page_breakpoints, true);
+        }
+
+        for (size_t i = 0; i < _debug->watchpoints.size(); ++i)
+        {
+            _memory->watch(this, _debug->watchpoints[i].first, _debug->watchpoints[i].second, 
+                boost::bind(&MipsCPU::watchTriggered, this, _1));
+        }
+    }
+
+    /**
+     * @brief Stops watching the memory this CPU is leaving, which may be
+     * shared and outlive it.
+     */
+    void MipsCPU::disarmDebugState()
+    {
+        if (_memory && !_debug->watchpoints.empty()) _memory->unwatchAll(this);
+    }
+
+    void MipsCPU::updateInstrumentation()
+    {
+        _instrumented = statisticsEnabled() || _trace || _profiler || _hooks || _coverage;
+    }
+
+    /**
+     * @brief Installs analysis callbacks.
+     *
+     * Hooks run in the instrumented run loop only. Without hooks (and the 
+     * other observers) the plain loop runs and the instruction handlers 
+     * never look at them, so unused hooks cost nothing.
+     */
+    void MipsCPU::setHooks(const Hooks& hooks)
+    {
+        if (hooks.empty()) _hooks.reset();
+        else _hooks.reset(new Hooks(hooks));
+
+        _nextSequential = no_block;
+        updateInstrumentation();
+    }
+
+    /**
+     * @brief Starts or stops edge coverage collection.
+     *
+     * The map is updated once per block transition, in the instrumented 
+     * run loop. Several CPUs may share a map.
+     */
+    void MipsCPU::attachCoverage(boost::shared_ptr<CoverageMap> coverage)
+    {
+        _coverage = coverage;
+        _nextSequential = no_block;
+        updateInstrumentation();
+    }
+
+    void MipsCPU::attachTrace(boost::shared_ptr<TraceBuffer> trace)
+    {
+        _trace = trace;
+        updateInstrumentation();
+    }
+
+    void MipsCPU::attachProfiler(boost::shared_ptr<Profiler> profiler)
+    {
+        _profiler = profiler;
+        updateInstrumentation();
+    }
+
+    /**
+     * @brief Turns the per-opcode counters on or off.
+     *
+     * The counters are owned by the instance and only written by the 
+     * thread running it, so there is no sharing between host threads. 
+     * When disabled, the counters take no memory and the plain run loop 
+     * is used.
+     */
+    void MipsCPU::enableStatistics(bool enable)
+    {
+        if (enable == statisticsEnabled()) return;
+
+        if (enable)
+        {
+            _opcodeCounts.reset(new boost::uint64_t[internal_opcode_count]);
+            resetStatistics();
+        }
+        else
+        {
+            _opcodeCounts.reset();
+        }
+
+        updateInstrumentation();
+    }
+
+    void MipsCPU::resetStatistics()
+    {
+        if (_opcodeCounts) 
+            std::fill(_opcodeCounts.get(), _opcodeCounts.get() + internal_opcode_count, 0);
+    }
+
+    /**
+     * @brief The number of retired instructions with the given internal opcode
+     * since statistics were enabled or reset.
+     */
+    boost::uint64_t MipsCPU::retiredCount(int internalOpcode) const
+    {
+        return _opcodeCounts ? _opcodeCounts[internalOpcode] : 0;
+    }
+
+    /**
+     * @brief Drains the pending event word.
+     *
+     * Interrupt lines are latched until cleared by clearInterrupt.
+     *
+     * @return True if a stop was requested or a watched word was written.
+     */
+    bool MipsCPU::pollEvents()
+    {
+        boost::uint32_t events = _events.exchange(0, boost::memory_order_acquire);
+        boost::uint32_t lines = _interruptLines | (events & event_interrupt_mask);
+
+        // a replaying CPU only sees the recorded interrupts
+        if (!_replayer && lines != _interruptLines)
+        {
+            _interruptLines = lines;
+            if (_recorder) _recorder->interrupts(_instructions, lines);
+        }
+
+        if (events & event_watch) watchStop();
+
+        return (events & (event_stop | event_watch)) != 0;
+    }
+
+    void MipsCPU::raiseInterrupt(int line)
+    {
+        checkInterruptLine(line);
+        _events.fetch_or(1u << line, boost::memory_order_release);
+    }
+
+    void MipsCPU::clearInterrupt(int line)
+    {
+        checkInterruptLine(line);
+        _interruptLines &= ~(1u << line);
+        if (_recorder) _recorder->interrupts(_instructions, _interruptLines);
+    }
+
+    void MipsCPU::deliverReplayedInterrupts()
+    {
+        while (_replayer->nextInterrupt() == _instructions) 
+            _interruptLines = _replayer->takeInterrupt();
+    }
+
+    /**
+     * @brief Copies the registers and, unless includeMemory is false, the whole memory.
+     */
+    void MipsCPU::saveSnapshot(Snapshot& snapshot, bool includeMemory) const
+    {
+        std::memcpy(snapshot.gpr, _GPR, sizeof(_GPR));
+        std::memcpy(snapshot.fpr, _FPR, sizeof(_FPR));
+        std::memcpy(snapshot.fcr, _FCR, sizeof(_FCR));
+        snapshot.hi = _HI;
+        snapshot.lo = _LO;
+        snapshot.pc = _PC;
+        snapshot.npc = _nPC;
+        snapshot.fcsr = _FCSR;
+        snapshot.interruptLines = _interruptLines;
+        snapshot.instructions = _instructions;
+        snapshot.status = cop0(cop0_status);
+        snapshot.cause = _cause;
+        snapshot.epc = cop0(cop0_epc);
+        snapshot.badVAddr = cop0(cop0_badvaddr);
+        snapshot.count = cop0(cop0_count);
+        snapshot.compare = cop0(cop0_compare);
+
+        if (_memory && includeMemory)
+        {
+            _memory->save(snapshot.memory);
+            snapshot.textEnd = _memory->textEnd();
+        }
+        else
+        {
+            snapshot.memory.clear();
+            snapshot.textEnd = 0;
+        }
+    }
+
+    /**
+     * @brief Puts back a snapshot. The memory is replaced by a new private 
+     * one unless the attached memory has the right size. A snapshot taken
+     * without memory leaves the memory alone.
+     */
+    void MipsCPU::restoreSnapshot(const Snapshot& snapshot)
+    {
+        reset();
+
+        std::memcpy(_GPR, snapshot.gpr, sizeof(_GPR));
+        std::memcpy(_FPR, snapshot.fpr, sizeof(_FPR));
+        std::memcpy(_FCR, snapshot.fcr, sizeof(_FCR));
+        _HI = snapshot.hi;
+        _LO = snapshot.lo;
+        _PC = snapshot.pc;
+        _nPC = snapshot.npc;
+        _FCSR = snapshot.fcsr;
+        _interruptLines = snapshot.interruptLines;
+        _instructions = snapshot.instructions;
+        // COP0 left in its reset state needs no allocation
+        if (snapshot.status || snapshot.epc || snapshot.badVAddr || snapshot.compare || 
+            snapshot.count != boost::uint32_t(snapshot.instructions))
+        {
+            Cop0& cop0 = cop0State();
+            cop0.status = snapshot.status;
+            cop0.epc = snapshot.epc;
+            cop0.badVAddr = snapshot.badVAddr;
+            setCop0(cop0_count, snapshot.count);
+            setCop0(cop0_compare, snapshot.compare);
+        }
+        _cause = snapshot.cause;
+        updateTimerDeadline();
+
+        if (snapshot.memory.empty()) return;
+
+        size_t bytes = snapshot.memory.size() * sizeof(boost::uint32_t);
+        bool newMemory = !_memory || _memory->size() != bytes;
+        if (newMemory)
+        {
+            if (_debug) disarmDebugState();
+            _memory.reset(new Memory(bytes));
+        }
+        _memory->restore(snapshot.memory, snapshot.textEnd);
+
+        // like loadProgram, a new memory needs the debug state flagged
+        if (newMemory && _debug) armDebugState();
     }
 
 } // tememu
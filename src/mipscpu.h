@@ -25,12 +25,23 @@
 #ifndef _MIPSCPU_H
 #define _MIPSCPU_H
 
+#include "consts.h"
+#include "coverage.h"
+#include "hooks.h"
+#include "memory.h"
+#include "profiler.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "tracebuffer.h"
+
+#include <boost/atomic.hpp>
+#include <boost/config.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/unordered_map.hpp>
 
-#include <map>
-#include <string>
 #include <vector>
 
 #define CALL_MEMBER(obj,fn) ((obj)->*(fn))
@@ -39,14 +50,20 @@
 #define RS(i) ((i & 0x03E00000) >> 21)        // extract bits 6..10
 #define RT(i) ((i & 0x001F0000) >> 16)        // extract bits 11..15
 #define RD(i) ((i & 0x0000F800) >> 11)        // extract bits 16..20
-#define SHAMT(i) ((i & 0x000001F0) >> 4)     // extract bits 21..25
+#define SHAMT(i) ((i & 0x000007C0) >> 6)     // extract bits 21..25
 #define FUNCT(i) (i & 0x0000003F)            // extract bits 26..31
 #define IMMEDIATE(i) (i & 0x0000FFFF) // extract bits 16..31
 #define ADDRESS(i) ((i & 0x03ffffff) << 2) // extract bits 6..31
 
+// COP1 fields: the format is in rs, the registers in rt, rd and shamt
+#define FMT(i) RS(i)
+#define FPR_T(i) RT(i)
+#define FPR_S(i) RD(i)
+#define FPR_D(i) SHAMT(i)
+
 namespace tememu 
 {
-    typedef boost::int_fast32_t int32;
+    typedef boost::int32_t int32;
 
     union int_short { short s; int32 i; };
 
@@ -57,25 +74,183 @@ namespace tememu
     class MipsCPU 
     {
         typedef void (MipsCPU::*OpcodeFn)(int32);
+        struct OpcodeTable;
+        struct DebugState;
+        struct Cop0;
 
     public:
+        /**
+         * @brief Called on syscall. Returning false blocks the CPU until unblock().
+         */
+        typedef boost::function<bool (MipsCPU&)> HostCallHandler;
+
+        // bits of the pending event word: interrupt lines 0..7, a write to a
+        // watched word and a stop request
+        static const boost::uint32_t event_interrupt_mask = 0x000000FF;
+        static const boost::uint32_t event_watch = 0x40000000;
+        static const boost::uint32_t event_stop = 0x80000000;
+
         MipsCPU();
-        ~MipsCPU() {}
+        ~MipsCPU();
 
     private:
+        int execute(int budget);
+        template <bool Instrumented, bool Breakpoints> int runSlice(int slice, boost::uint32_t textEnd);
+        void retired(boost::uint32_t pc, int32 instr);
+        void runHooked(boost::uint32_t pc, int32 instr);
+        void enterBlock(boost::uint32_t pc);
+        void replayHostCall();
+        bool breakpointHit(boost::uint32_t pc);
+        void watchTriggered(boost::uint32_t addr);
+        void watchStop();
+        void armDebugState();
+        void disarmDebugState();
+        void deliverReplayedInterrupts();
+        void updateInstrumentation();
         void runDecodedInstr(int32 instr);
         void advance_pc(int32 offset);
         void step() { advance_pc(sizeof(int32)); }
+        boost::uint32_t effectiveAddress(int32 instr) const;
+        boost::uint64_t hiLo() const;
+        void setHiLo(boost::uint64_t value);
+        float fprSingle(int index) const;
+        void setFprSingle(int index, float value);
+        double fprDouble(int index) const;
+        void setFprDouble(int index, double value);
+        bool fpuCondition(int cc) const;
+        void setFpuCondition(int cc, bool value);
+        BOOST_NOINLINE void raiseException(int code, boost::uint32_t badAddr = 0);
+        BOOST_NOINLINE boost::uint32_t badFetch(boost::uint32_t target);
+        void fetchFault();
+        void takeInterrupt();
+        Cop0& cop0State();
+        void updateTimerDeadline();
+        void timerExpired();
+        void completeTimerAccess();
+
+        // unaligned or outside the memory: an address error for the guest
+        bool badAddress(boost::uint32_t addr) const { return (addr & 3) || !_memory->contains(addr); }
+
+        boost::uint32_t readWord(boost::uint32_t addr) const
+        {
+            return _storeBuffer ? _storeBuffer->read(*_memory, addr) : _memory->readWord(addr);
+        }
+
+        void writeWord(boost::uint32_t addr, boost::uint32_t value)
+        {
+            if (_storeBuffer) _storeBuffer->write(*_memory, addr, value);
+            else 
+            {
+                _memory->writeWord(addr, value);
+                takeWatchHit();
+            }
+        }
+
+        // a store of this CPU to a watched word stops it right after the instruction
+        void takeWatchHit()
+        {
+            if (BOOST_UNLIKELY(_events.load(boost::memory_order_relaxed) & event_watch) &&
+                (_events.fetch_and(~event_watch, boost::memory_order_acquire) & event_watch))
+                watchStop();
+        }
 
     public:
         void loadProgram(boost::shared_ptr< std::vector<int32> >);
-        void stepProgram(int numSteps = 1);
+        void attachMemory(boost::shared_ptr<Memory> memory);
+        boost::shared_ptr<Memory> memory() const { return _memory; }
+        void setHostCallHandler(const HostCallHandler& handler) { _hostCall = handler; }
+        int stepProgram(int numSteps = 1);
         void runProgram();
+        bool halted() const;
+        bool blocked() const { return (_stall & stall_blocked) != 0; }
+        void unblock();
+
+        // deterministic mode: stores go to the buffer, sc and sync stop the 
+        // CPU at a sync point and are completed at the next barrier
+        void setStoreBuffer(StoreBuffer* buffer) { _storeBuffer = buffer; }
+        bool atSyncPoint() const { return (_stall & stall_sync) != 0; }
+        void completeSyncPoint();
+        bool pollEvents();
+
+        // may be called from any thread while the CPU is running
+        void requestStop() { _events.fetch_or(event_stop, boost::memory_order_release); }
+        void raiseInterrupt(int line);
+
+        boost::uint32_t pendingInterrupts() const { return _interruptLines; }
+        void clearInterrupt(int line);
+        // instructions retired since reset, or restored from a snapshot
+        boost::uint64_t instructionCount() const { return _instructions; }
+        // per-opcode retired instruction counts; switch only while the CPU is not running
+        void enableStatistics(bool enable);
+        bool statisticsEnabled() const { return _opcodeCounts.get() != 0; }
+        void resetStatistics();
+        boost::uint64_t retiredCount(int internalOpcode) const;
+        static int internalOpcode(int32 instr);
+
+        // records every retired instruction into the buffer; pass an empty pointer to stop
+        void attachTrace(boost::shared_ptr<TraceBuffer> trace);
+        void attachProfiler(boost::shared_ptr<Profiler> profiler);
+        // replaces the analysis callbacks; pass empty Hooks to remove them
+        void setHooks(const Hooks& hooks);
+        // counts block transitions into the map; pass an empty pointer to stop
+        void attachCoverage(boost::shared_ptr<CoverageMap> coverage);
+
+        // record/replay of the nondeterministic inputs, see replay.h
+        void saveSnapshot(Snapshot& snapshot, bool includeMemory = true) const;
+        void restoreSnapshot(const Snapshot& snapshot);
+        void attachRecorder(boost::shared_ptr<Recorder> recorder) { _recorder = recorder; }
+        void attachReplayer(boost::shared_ptr<Replayer> replayer) { _replayer = replayer; }
+        // for host call handlers: a store to guest memory that is recorded
+        void writeGuestWord(boost::uint32_t addr, boost::uint32_t value);
+
+        // execution stops before an instruction with a breakpoint and after
+        // a write to a watched range; see debugStop() for which one
+        enum DebugStop { debug_none, debug_breakpoint, debug_watchpoint };
+        void addBreakpoint(boost::uint32_t addr);
+        void removeBreakpoint(boost::uint32_t addr);
+        bool hasBreakpoint(boost::uint32_t addr) const;
+        void addWatchpoint(boost::uint32_t addr, boost::uint32_t length);
+        void removeWatchpoint(boost::uint32_t addr, boost::uint32_t length);
+        DebugStop debugStop() const;
+        boost::uint32_t watchAddress() const;
+
+        static const char* opcodeName(int internalOpcode);
+
         void reset();
+        // the address of the next instruction to execute
+        boost::uint32_t pc() const { return _PC; }
         int32 gprValue(int index) const { return _GPR[index]; }
         void setGPR(int index, int32 value) { _GPR[index] = value; } // range checking?
         int32 hi() const { return _HI; }
         int32 lo() const { return _LO; }
+        int32 fprValue(int index) const { return _FPR[index]; }
+        void setFPR(int index, int32 value) { _FPR[index] = value; }
+        boost::uint32_t fcsr() const { return _FCSR; }
+        // takes effect at the next stepProgram or runProgram
+        void setFCSR(boost::uint32_t value) { _FCSR = value; }
+        boost::uint32_t fir() const { return _FCR[0]; }
+
+        // COP0 registers, by their mfc0/mtc0 numbers
+        enum 
+        { 
+            cop0_badvaddr = 8, cop0_count = 9, cop0_compare = 11, 
+            cop0_status = 12, cop0_cause = 13, cop0_epc = 14 
+        };
+        // Cause.ExcCode values
+        enum 
+        { 
+            exc_interrupt = 0, exc_address_load = 4, exc_address_store = 5, 
+            exc_syscall = 8, exc_breakpoint = 9, exc_overflow = 12 
+        };
+        boost::uint32_t cop0(int reg) const;
+        void setCop0(int reg, boost::uint32_t value);
+        // exceptions jump to base + 0x180. The default base 0x80000000 is 
+        // outside the text, so a program without handlers halts at its 
+        // first exception; a base of 0 runs the handler in the text.
+        void setExceptionBase(boost::uint32_t base);
+        void setPC(boost::uint32_t pc) { _PC = pc; _nPC = pc + 4; }
+        void setHI(int32 value) { _HI = value; }
+        void setLO(int32 value) { _LO = value; }
 
     private:
         // arithmetic instructions
@@ -86,6 +261,12 @@ namespace tememu
         void op_sub(int32);
         void op_subu(int32);
         void op_mult(int32);
+        void op_multu(int32);
+        void op_madd(int32);
+        void op_maddu(int32);
+        void op_msub(int32);
+        void op_msubu(int32);
+        void op_mul(int32);
         void op_div(int32);
         void op_divu(int32);
 
@@ -95,6 +276,7 @@ namespace tememu
         void op_j(int32);
         void op_jr(int32);
         void op_jal(int32);
+        void op_jalr(int32);
 
         // moving
         void op_mfhi(int32);
@@ -102,6 +284,18 @@ namespace tememu
         void op_mthi(int32);
         void op_mtlo(int32);
 
+        // system
+        void op_syscall(int32);
+        void op_break(int32);
+        void op_cop0(int32);
+
+        // memory access and synchronization
+        void op_lw(int32);
+        void op_sw(int32);
+        void op_ll(int32);
+        void op_sc(int32);
+        void op_sync(int32);
+
         // logical instructions
         void op_and(int32);
         void op_andi(int32);
@@ -109,15 +303,110 @@ namespace tememu
         void op_ori(int32);
         void op_xor(int32);
         void op_nor(int32);
+
+        // shifts
+        void op_sll(int32);
+        void op_srl(int32);
+        void op_sra(int32);
+        void op_sllv(int32);
+        void op_srlv(int32);
+        void op_srav(int32);
+
+        // floating point (COP1)
+        void op_mfc1(int32);
+        void op_mtc1(int32);
+        void op_cfc1(int32);
+        void op_ctc1(int32);
+        void op_bc1(int32);
+        void op_lwc1(int32);
+        void op_swc1(int32);
+        void op_add_s(int32);
+        void op_sub_s(int32);
+        void op_mul_s(int32);
+        void op_div_s(int32);
+        void op_sqrt_s(int32);
+        void op_abs_s(int32);
+        void op_mov_s(int32);
+        void op_neg_s(int32);
+        void op_trunc_w_s(int32);
+        void op_cvt_d_s(int32);
+        void op_cvt_w_s(int32);
+        void op_c_s(int32);
+        void op_add_d(int32);
+        void op_sub_d(int32);
+        void op_mul_d(int32);
+        void op_div_d(int32);
+        void op_sqrt_d(int32);
+        void op_abs_d(int32);
+        void op_mov_d(int32);
+        void op_neg_d(int32);
+        void op_trunc_w_d(int32);
+        void op_cvt_s_d(int32);
+        void op_cvt_w_d(int32);
+        void op_c_d(int32);
+        void op_cvt_s_w(int32);
+        void op_cvt_d_w(int32);
+
+        // comparison
+        void op_slt(int32);
+        void op_sltu(int32);
+        void op_slti(int32);
+        void op_sltiu(int32);
     
     private:
-        std::vector<int32> _GPR, _FPR, _FCR;
-        boost::shared_ptr< std::vector<int32> > _program;
-        boost::unordered_map<int32, OpcodeFn> _fnMap;
-#ifdef TRACE_OPCODES
-        boost::unordered_map<int32, std::string> _opNameMap;
-#endif
+        // shared by every instance, see mipscpu.cpp
+        static const OpcodeTable _opcodes;
+
+        int32 _GPR[gpr_count], _FPR[fpr_count], _FCR[fcr_count];
         int32 _HI, _LO, _PC, _nPC, _FCSR;
+        boost::shared_ptr<Memory> _memory;
+        HostCallHandler _hostCall;
+
+        // LL/SC reservation: the linked address and the value LL observed
+        boost::uint32_t _llAddr;
+        boost::uint32_t _llValue;
+        bool _llValid;
+
+        // reasons for the run loop to stop before the budget is used up
+        enum 
+        { 
+            stall_blocked = 1, stall_sync = 2, stall_break = 4, stall_cop0 = 8, stall_timer = 16, 
+            stall_exception = 32 
+        };
+        boost::uint8_t _stall;
+        // true if any of the observers below needs the instrumented run loop
+        bool _instrumented;
+        // COP0 Cause; inline because the run loop checks it every slice
+        boost::uint32_t _cause;
+
+        StoreBuffer* _storeBuffer;
+
+        // posted by other threads, drained by the CPU between slices
+        boost::atomic<boost::uint32_t> _events;
+        boost::uint32_t _interruptLines;
+        boost::uint64_t _instructions;
+        // the instruction count at which Count next equals Compare; the run 
+        // loop ends a slice there
+        boost::uint64_t _timerDeadline;
+
+        boost::shared_ptr<Recorder> _recorder;
+        boost::shared_ptr<Replayer> _replayer;
+
+        boost::scoped_array<boost::uint64_t> _opcodeCounts;
+        boost::shared_ptr<TraceBuffer> _trace;
+        boost::shared_ptr<Profiler> _profiler;
+        boost::scoped_ptr<Hooks> _hooks;
+        boost::shared_ptr<CoverageMap> _coverage;
+        // where the current block continues; anything else starts a new block
+        boost::uint32_t _nextSequential;
+        boost::uint32_t _blockStart;
+
+        // breakpoints and watchpoints, allocated when the first one is added
+        boost::scoped_ptr<DebugState> _debug;
+
+        // the other COP0 registers, allocated on first use so that creating
+        // a CPU allocates nothing; see cop0State
+        boost::scoped_ptr<Cop0> _cop0;
     };
     
 } // tememu
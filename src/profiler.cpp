@@ -0,0 +1,226 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "profiler.h"
+#include "mipscpu.h"
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace tememu 
+{
+    namespace
+    {
+        Profiler* timer_profiler = 0;
+
+        void onProfilingTimer(int)
+        {
+            Profiler* profiler = timer_profiler;
+            if (profiler) profiler->requestSample();
+        }
+
+        void writeWord(std::ostream& os, boost::uint64_t word)
+        {
+            uintptr_t value = static_cast<uintptr_t>(word);
+            os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+    }
+
+    const size_t Profiler::max_depth;
+
+    /**
+     * @param period Retired instructions between two samples; 0 disables 
+     * instruction count sampling, leaving only requested samples.
+     */
+    Profiler::Profiler(boost::uint64_t period)
+        : _period(period), _countdown(period), _sampleRequested(false), 
+          _lostFrames(0), _sampleCount(0)
+    {
+        _stack.reserve(max_depth);
+    }
+
+    Profiler::~Profiler()
+    {
+        if (timer_profiler == this) stopTimer();
+    }
+
+    /**
+     * @brief Called by the CPU after each retired instruction.
+     *
+     * The sample is taken before the shadow stack is updated, so a call 
+     * instruction counts in the caller and a return in the callee.
+     */
+    void Profiler::retired(const MipsCPU& cpu, boost::uint32_t pc, boost::int32_t instr)
+    {
+        if ((_period && --_countdown == 0) || _sampleRequested.load(boost::memory_order_relaxed))
+        {
+            _countdown = _period;
+            _sampleRequested.store(false, boost::memory_order_relaxed);
+            sample(pc);
+        }
+
+        int opcode = OPCODE(instr);
+
+        if (opcode == 0x03 || (opcode == 0 && FUNCT(instr) == 0x09)) // jal, jalr
+        {
+            Frame frame;
+            frame.entry = opcode ? ((pc + 4) & 0xf0000000) | ADDRESS(instr) : cpu.gprValue(RS(instr));
+            frame.returnAddress = cpu.gprValue(opcode ? 31 : RD(instr));
+
+            if (_stack.size() < max_depth) _stack.push_back(frame);
+            else ++_lostFrames;
+        }
+        else if (opcode == 0 && FUNCT(instr) == 0x08) // jr
+        {
+            boost::uint32_t target = cpu.gprValue(RS(instr));
+
+            if (_lostFrames > 0) 
+            {
+                --_lostFrames;
+                return;
+            }
+
+            // unwind to the frame returning there; a jr that is not a 
+            // return (e.g. a jump table) matches no frame and changes nothing
+            for (size_t i = _stack.size(); i > 0; --i)
+            {
+                if (_stack[i - 1].returnAddress == target)
+                {
+                    _stack.resize(i - 1);
+                    break;
+                }
+            }
+        }
+    }
+
+    void Profiler::sample(boost::uint32_t pc)
+    {
+        std::vector<boost::uint32_t> pcs, calls;
+
+        pcs.reserve(_stack.size() + 1);
+        pcs.push_back(pc);
+        for (size_t i = _stack.size(); i > 0; --i) 
+            pcs.push_back(_stack[i - 1].returnAddress);
+
+        calls.reserve(_stack.size() + 1);
+        calls.push_back(0); // the program entry
+        for (size_t i = 0; i < _stack.size(); ++i) 
+            calls.push_back(_stack[i].entry);
+
+        ++_pcStacks[pcs];
+        ++_callStacks[calls];
+        ++_sampleCount;
+    }
+
+    /**
+     * @brief Requests a sample hz times per second of host CPU time (SIGPROF).
+     *
+     * Only one profiler can use the timer at a time, and hz must be within
+     * 1..1000000 since the period is set in whole microseconds.
+     */
+    void Profiler::startTimer(int hz)
+    {
+        if (hz < 1 || hz > 1000000)
+            throw std::invalid_argument("Profiler: timer frequency out of range");
+
+        if (timer_profiler && timer_profiler != this)
+            throw std::logic_error("Profiler: the profiling timer is already in use");
+
+        timer_profiler = this;
+
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_handler = &onProfilingTimer;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, 0);
+
+        struct itimerval timer;
+        timer.it_interval.tv_sec = hz == 1 ? 1 : 0;
+        timer.it_interval.tv_usec = hz == 1 ? 0 : 1000000 / hz;
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, 0);
+    }
+
+    void Profiler::stopTimer()
+    {
+        struct itimerval timer;
+        std::memset(&timer, 0, sizeof(timer));
+        setitimer(ITIMER_PROF, &timer, 0);
+
+        timer_profiler = 0;
+    }
+
+    /**
+     * @brief Writes the samples as folded stacks ("outer;inner count" lines),
+     * the input format of flamegraph.pl and most flame graph viewers.
+     */
+    void Profiler::writeFolded(std::ostream& os, const SymbolTable& symbols) const
+    {
+        std::map<std::vector<boost::uint32_t>, boost::uint64_t>::const_iterator it;
+
+        for (it = _callStacks.begin(); it != _callStacks.end(); ++it)
+        {
+            const std::vector<boost::uint32_t>& calls = it->first;
+
+            for (size_t i = 0; i < calls.size(); ++i)
+                os << (i ? ";" : "") << symbols.nameOrAddress(calls[i]);
+
+            os << " " << it->second << "\n";
+        }
+    }
+
+    /**
+     * @brief Writes the samples in the legacy gperftools CPU profile format,
+     * which pprof reads. Addresses are guest addresses; the sampling period
+     * field holds the instruction period rather than microseconds.
+     */
+    void Profiler::writePprof(std::ostream& os) const
+    {
+        writeWord(os, 0);       // header count
+        writeWord(os, 3);       // header words
+        writeWord(os, 0);       // version
+        writeWord(os, _period); // sampling period
+        writeWord(os, 0);       // padding
+
+        std::map<std::vector<boost::uint32_t>, boost::uint64_t>::const_iterator it;
+
+        for (it = _pcStacks.begin(); it != _pcStacks.end(); ++it)
+        {
+            writeWord(os, it->second);
+            writeWord(os, it->first.size());
+            for (size_t i = 0; i < it->first.size(); ++i) 
+                writeWord(os, it->first[i]);
+        }
+
+        writeWord(os, 0);       // trailer
+        writeWord(os, 1);
+        writeWord(os, 0);
+    }
+
+} // tememu
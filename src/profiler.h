@@ -0,0 +1,101 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include "symbols.h"
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <map>
+#include <ostream>
+#include <vector>
+
+namespace tememu 
+{
+    class MipsCPU;
+
+    /**
+     * @brief Sampling profiler of guest code.
+     *
+     * Samples the guest PC every period retired instructions, and whenever
+     * requestSample() is called (e.g. from a host timer, see startTimer). 
+     * The guest call chain comes from a shadow stack kept up to date by
+     * jal/jalr (push) and jr to the saved return address (pop), so the
+     * guest binary needs no instrumentation.
+     *
+     * A profiler belongs to one CPU at a time; it is not thread safe.
+     */
+    class Profiler : boost::noncopyable
+    {
+    public:
+        explicit Profiler(boost::uint64_t period = 1000);
+        ~Profiler();
+
+        void retired(const MipsCPU& cpu, boost::uint32_t pc, boost::int32_t instr);
+
+        // async signal safe
+        void requestSample() { _sampleRequested.store(true, boost::memory_order_relaxed); }
+
+        void startTimer(int hz);
+        void stopTimer();
+
+        boost::uint64_t sampleCount() const { return _sampleCount; }
+        size_t depth() const { return _stack.size(); }
+
+        void writeFolded(std::ostream& os, const SymbolTable& symbols) const;
+        void writePprof(std::ostream& os) const;
+
+    private:
+        struct Frame
+        {
+            boost::uint32_t entry;          // the called function
+            boost::uint32_t returnAddress;  // where it returns to in the caller
+        };
+
+        void sample(boost::uint32_t pc);
+
+    private:
+        static const size_t max_depth = 256;
+
+        const boost::uint64_t _period;
+        boost::uint64_t _countdown;
+        boost::atomic<bool> _sampleRequested;
+
+        std::vector<Frame> _stack;
+        size_t _lostFrames;  // calls deeper than max_depth, not on _stack
+
+        // leaf PC followed by the return addresses, for pprof
+        std::map<std::vector<boost::uint32_t>, boost::uint64_t> _pcStacks;
+        // function entries from the outermost, for flame graphs
+        std::map<std::vector<boost::uint32_t>, boost::uint64_t> _callStacks;
+        boost::uint64_t _sampleCount;
+    };
+
+} // tememu
+
+#endif //include guard
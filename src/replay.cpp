@@ -0,0 +1,332 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "replay.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace tememu
+{
+    namespace
+    {
+        const char log_magic[8] = { 'T', 'M', 'R', 'E', 'P', 'L', 'A', 'Y' };
+
+        enum { tag_host_call = 1, tag_interrupts = 2, tag_syscall_exception = 3 };
+
+        // the CPU hands the buffer to the writer thread when it gets this big
+        const size_t hand_off_size = 64 * 1024;
+
+        class LogReader
+        {
+        public:
+            LogReader(const std::vector<boost::uint8_t>& data, size_t pos) : _data(data), _pos(pos) {}
+
+            bool atEnd() const { return _pos == _data.size(); }
+
+            boost::uint8_t byte()
+            {
+                if (atEnd()) throw std::runtime_error("Replayer: truncated log");
+                return _data[_pos++];
+            }
+
+            boost::uint64_t varint()
+            {
+                boost::uint64_t value = 0;
+                for (int shift = 0; ; shift += 7)
+                {
+                    boost::uint8_t b = byte();
+                    value |= boost::uint64_t(b & 0x7F) << shift;
+                    if (!(b & 0x80)) return value;
+                }
+            }
+
+            boost::uint32_t word()
+            {
+                boost::uint32_t value = 0;
+                for (int i = 0; i < 4; ++i) value |= boost::uint32_t(byte()) << (8 * i);
+                return value;
+            }
+
+        private:
+            const std::vector<boost::uint8_t>& _data;
+            size_t _pos;
+        };
+    }
+
+    Recorder::Recorder()
+        : _inMemory(true), _hostCalls(0), _inHostCall(false), _lastInterrupt(0), 
+          _writing(false), _stop(false)
+    {
+    }
+
+    Recorder::Recorder(const std::string& path)
+        : _inMemory(false), _file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc),
+          _hostCalls(0), _inHostCall(false), _lastInterrupt(0), _writing(false), _stop(false)
+    {
+        if (!_file) throw std::runtime_error("Recorder: cannot create " + path);
+
+        _file.write(log_magic, sizeof(log_magic));
+        _buffer.reserve(hand_off_size);
+        _writer = boost::thread(boost::bind(&Recorder::writerLoop, this));
+    }
+
+    Recorder::~Recorder()
+    {
+        if (_inMemory) return;
+        flush();
+
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _stop = true;
+        }
+
+        _wake.notify_one();
+        _writer.join();
+    }
+
+    void Recorder::beginHostCall(const boost::int32_t* gprs)
+    {
+        std::memcpy(_before, gprs, sizeof(_before));
+        _writes.clear();
+        _inHostCall = true;
+    }
+
+    void Recorder::memoryWritten(boost::uint32_t addr, boost::uint32_t value)
+    {
+        if (_inHostCall) _writes.push_back(std::make_pair(addr, value));
+    }
+
+    /**
+     * @brief Logs the registers that differ from beginHostCall, the memory
+     * writes and the interrupt lines.
+     */
+    void Recorder::endHostCall(const boost::int32_t* gprs, boost::uint32_t interruptLines)
+    {
+        if (!_inHostCall) return;
+
+        boost::uint32_t changed = 0;
+        for (int i = 0; i < gpr_count; ++i)
+        {
+            if (gprs[i] != _before[i]) changed |= 1u << i;
+        }
+
+        putByte(tag_host_call);
+        putVarint(changed);
+        for (int i = 0; i < gpr_count; ++i)
+        {
+            if (changed & (1u << i)) putWord(gprs[i]);
+        }
+
+        putVarint(interruptLines);
+        putVarint(_writes.size());
+        for (size_t i = 0; i < _writes.size(); ++i)
+        {
+            putVarint(_writes[i].first);
+            putWord(_writes[i].second);
+        }
+
+        _inHostCall = false;
+        ++_hostCalls;
+        if (_buffer.size() >= hand_off_size) handOff();
+    }
+
+    /**
+     * @brief Logs a syscall that found no handler; it takes the place of a
+     * host call, so the host call positions of the checkpoints still hold.
+     */
+    void Recorder::syscallException()
+    {
+        putByte(tag_syscall_exception);
+        ++_hostCalls;
+        if (_buffer.size() >= hand_off_size) handOff();
+    }
+
+    /**
+     * @brief Logs the interrupt lines as they are from the given retired
+     * instruction count on. Changes during a host call are part of its result.
+     */
+    void Recorder::interrupts(boost::uint64_t instructions, boost::uint32_t lines)
+    {
+        if (_inHostCall) return;
+
+        putByte(tag_interrupts);
+        putVarint(instructions - _lastInterrupt);
+        putVarint(lines);
+        _lastInterrupt = instructions;
+
+        if (_buffer.size() >= hand_off_size) handOff();
+    }
+
+    void Recorder::flush()
+    {
+        if (_inMemory) return;
+        handOff();
+
+        boost::mutex::scoped_lock lock(_mutex);
+        while (_writing || !_pending.empty()) _written.wait(lock);
+    }
+
+    void Recorder::putVarint(boost::uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            putByte(static_cast<boost::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        putByte(static_cast<boost::uint8_t>(value));
+    }
+
+    void Recorder::putWord(boost::uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i) putByte(static_cast<boost::uint8_t>(value >> (8 * i)));
+    }
+
+    void Recorder::handOff()
+    {
+        if (_inMemory || _buffer.empty()) return;
+
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _pending.insert(_pending.end(), _buffer.begin(), _buffer.end());
+        }
+
+        _buffer.clear();
+        _wake.notify_one();
+    }
+
+    void Recorder::writerLoop()
+    {
+        std::vector<boost::uint8_t> chunk;
+        boost::mutex::scoped_lock lock(_mutex);
+
+        for (;;)
+        {
+            while (_pending.empty() && !_stop) _wake.wait(lock);
+            if (_pending.empty()) break;
+
+            chunk.swap(_pending);
+            _writing = true;
+            lock.unlock();
+
+            _file.write(reinterpret_cast<const char*>(&chunk[0]), chunk.size());
+            _file.flush();
+            chunk.clear();
+
+            lock.lock();
+            _writing = false;
+            _written.notify_all();
+        }
+    }
+
+    Replayer::Replayer(const std::string& path)
+    {
+        std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+        if (!file) throw std::runtime_error("Replayer: cannot open " + path);
+
+        std::vector<boost::uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.size() < sizeof(log_magic) || std::memcmp(&data[0], log_magic, sizeof(log_magic)) != 0)
+            throw std::runtime_error("Replayer: not a replay log");
+
+        parse(data, sizeof(log_magic));
+    }
+
+    Replayer::Replayer(const Recorder& recorder, size_t skipHostCalls, boost::uint64_t fromInstruction)
+    {
+        parse(recorder.data(), 0);
+
+        _hostCalls.erase(_hostCalls.begin(), _hostCalls.begin() + std::min(skipHostCalls, _hostCalls.size()));
+        while (!_interrupts.empty() && _interrupts.front().first < fromInstruction) _interrupts.pop_front();
+    }
+
+    void Replayer::parse(const std::vector<boost::uint8_t>& data, size_t offset)
+    {
+        LogReader reader(data, offset);
+        boost::uint64_t instructions = 0;
+
+        // host calls and interrupts are independent streams, each in order
+        while (!reader.atEnd())
+        {
+            switch (reader.byte())
+            {
+            case tag_host_call:
+            {
+                HostCallRecord record;
+                boost::uint32_t changed = static_cast<boost::uint32_t>(reader.varint());
+
+                for (int i = 0; i < gpr_count; ++i)
+                {
+                    if (changed & (1u << i)) record.registers.push_back(std::make_pair(i, boost::int32_t(reader.word())));
+                }
+
+                record.interruptLines = static_cast<boost::uint32_t>(reader.varint());
+                for (boost::uint64_t n = reader.varint(); n > 0; --n)
+                {
+                    boost::uint32_t addr = static_cast<boost::uint32_t>(reader.varint());
+                    record.writes.push_back(std::make_pair(addr, reader.word()));
+                }
+
+                _hostCalls.push_back(record);
+                break;
+            }
+            case tag_syscall_exception:
+                _hostCalls.push_back(HostCallRecord());
+                _hostCalls.back().exception = true;
+                break;
+            case tag_interrupts:
+                instructions += reader.varint();
+                _interrupts.push_back(std::make_pair(instructions, static_cast<boost::uint32_t>(reader.varint())));
+                break;
+            default:
+                throw std::runtime_error("Replayer: corrupt log");
+            }
+        }
+    }
+
+    bool Replayer::nextHostCall(HostCallRecord& record)
+    {
+        if (_hostCalls.empty()) return false;
+
+        record = _hostCalls.front();
+        _hostCalls.pop_front();
+        return true;
+    }
+
+    boost::uint64_t Replayer::nextInterrupt() const
+    {
+        return _interrupts.empty() ? ~boost::uint64_t(0) : _interrupts.front().first;
+    }
+
+    boost::uint32_t Replayer::takeInterrupt()
+    {
+        boost::uint32_t lines = _interrupts.front().second;
+        _interrupts.pop_front();
+        return lines;
+    }
+
+} // tememu
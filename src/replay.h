@@ -0,0 +1,147 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include "consts.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tememu
+{
+    /**
+     * @brief What a host call changed: registers, guest memory written 
+     * through MipsCPU::writeGuestWord and the interrupt lines. A syscall
+     * without a host call handler raised the Syscall exception instead.
+     */
+    struct HostCallRecord
+    {
+        HostCallRecord() : interruptLines(0), exception(false) {}
+
+        std::vector< std::pair<int, boost::int32_t> > registers;
+        std::vector< std::pair<boost::uint32_t, boost::uint32_t> > writes;
+        boost::uint32_t interruptLines;
+        bool exception;
+    };
+
+    /**
+     * @brief Logs the nondeterministic inputs of a CPU, see MipsCPU::attachRecorder.
+     *
+     * Only host call results and the retired instruction counts at which
+     * the interrupt lines changed are logged; everything else follows from
+     * the starting snapshot. Records are varint encoded into a buffer owned
+     * by the CPU thread, and full buffers are written to the file by a 
+     * background thread.
+     */
+    class Recorder : boost::noncopyable
+    {
+    public:
+        // keeps the log in memory, see data()
+        Recorder();
+        explicit Recorder(const std::string& path);
+        ~Recorder();
+
+        // called by the CPU
+        void beginHostCall(const boost::int32_t* gprs);
+        void memoryWritten(boost::uint32_t addr, boost::uint32_t value);
+        void endHostCall(const boost::int32_t* gprs, boost::uint32_t interruptLines);
+        void syscallException();
+        void interrupts(boost::uint64_t instructions, boost::uint32_t lines);
+
+        // waits until everything recorded so far is in the file
+        void flush();
+
+        size_t hostCallCount() const { return _hostCalls; }
+        // the log of an in-memory recorder
+        const std::vector<boost::uint8_t>& data() const { return _buffer; }
+
+    private:
+        void putByte(boost::uint8_t byte) { _buffer.push_back(byte); }
+        void putVarint(boost::uint64_t value);
+        void putWord(boost::uint32_t value);
+        void handOff();
+        void writerLoop();
+
+    private:
+        bool _inMemory;
+        std::ofstream _file;
+        std::vector<boost::uint8_t> _buffer;
+        size_t _hostCalls;
+
+        // the state of the host call in progress
+        bool _inHostCall;
+        boost::int32_t _before[gpr_count];
+        std::vector< std::pair<boost::uint32_t, boost::uint32_t> > _writes;
+        boost::uint64_t _lastInterrupt;
+
+        // shared with the writer thread
+        boost::mutex _mutex;
+        boost::condition_variable _wake, _written;
+        std::vector<boost::uint8_t> _pending;
+        bool _writing, _stop;
+        boost::thread _writer;
+    };
+
+    /**
+     * @brief Reads a log written by Recorder and feeds it to a replaying CPU,
+     * see MipsCPU::attachReplayer.
+     */
+    class Replayer : boost::noncopyable
+    {
+    public:
+        explicit Replayer(const std::string& path);
+        // replays an in-memory log from a point in the recorded run
+        Replayer(const Recorder& recorder, size_t skipHostCalls, boost::uint64_t fromInstruction);
+
+        bool nextHostCall(HostCallRecord& record);
+
+        // retired instruction count of the next interrupt line change, or UINT64_MAX
+        boost::uint64_t nextInterrupt() const;
+        boost::uint32_t takeInterrupt();
+
+        bool finished() const { return _hostCalls.empty() && _interrupts.empty(); }
+        size_t remainingHostCalls() const { return _hostCalls.size(); }
+
+    private:
+        void parse(const std::vector<boost::uint8_t>& data, size_t offset);
+
+    private:
+        std::deque<HostCallRecord> _hostCalls;
+        std::deque< std::pair<boost::uint64_t, boost::uint32_t> > _interrupts;
+    };
+
+} // tememu
+
+#endif //include guard
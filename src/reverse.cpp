@@ -0,0 +1,262 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "mipscpu.h"
+#include "reverse.h"
+
+#include <algorithm>
+#include <climits>
+#include <set>
+#include <stdexcept>
+
+namespace tememu
+{
+    const size_t ReverseDebugger::default_budget;
+    const boost::uint64_t ReverseDebugger::default_interval;
+
+    ReverseDebugger::ReverseDebugger(MipsCPU& cpu, size_t memoryBudget, boost::uint64_t interval)
+        : _cpu(cpu), _budget(memoryBudget), _interval(std::max<boost::uint64_t>(interval, 1)), 
+          _used(0), _recorder(new Recorder), _present(cpu.instructionCount())
+    {
+        if (!_cpu.memory()) throw std::logic_error("ReverseDebugger: the CPU has no memory");
+
+        _cpu.attachRecorder(_recorder);
+        _cpu.memory()->trackPages();
+        takeCheckpoint();
+    }
+
+    ReverseDebugger::~ReverseDebugger()
+    {
+        _cpu.attachRecorder(boost::shared_ptr<Recorder>());
+        _cpu.attachReplayer(boost::shared_ptr<Replayer>());
+        _cpu.memory()->stopTrackingPages();
+    }
+
+    /**
+     * @brief Executes at most budget instructions, taking checkpoints on the way.
+     *
+     * @return The number of instructions executed.
+     */
+    int ReverseDebugger::run(int budget)
+    {
+        int done = 0;
+
+        while (done < budget)
+        {
+            if (_replayer && now() >= _present) goLive();
+
+            boost::uint64_t next = _checkpoints.back().registers.instructions + _interval;
+            boost::uint64_t chunk = std::min<boost::uint64_t>(budget - done, next - now());
+            if (_replayer) chunk = std::min(chunk, _present - now());
+
+            int executed = _cpu.stepProgram(static_cast<int>(chunk));
+            done += executed;
+
+            if (now() >= next) takeCheckpoint();
+            if (executed < static_cast<int>(chunk)) break;
+        }
+
+        if (!_replayer) _present = std::max(_present, now());
+        return done;
+    }
+
+    /**
+     * @brief Goes to the state before the given instruction.
+     *
+     * @return False if that is before the first checkpoint (or in the future).
+     */
+    bool ReverseDebugger::seek(boost::uint64_t instruction)
+    {
+        if (instruction < _checkpoints.front().registers.instructions) return false;
+
+        if (instruction < now())
+        {
+            size_t index = _checkpoints.size() - 1;
+            while (_checkpoints[index].registers.instructions > instruction) --index;
+            restore(index);
+        }
+
+        while (now() < instruction)
+        {
+            boost::uint64_t left = instruction - now();
+            if (run(static_cast<int>(std::min<boost::uint64_t>(left, INT_MAX))) == 0) return false;
+        }
+
+        return true;
+    }
+
+    bool ReverseDebugger::reverseStep()
+    {
+        return now() > _checkpoints.front().registers.instructions && seek(now() - 1);
+    }
+
+    /**
+     * @brief Goes back to the latest earlier point where stop is true.
+     *
+     * Searches interval by interval, stepping through each one from its
+     * checkpoint. If there is no such point, stops at the first checkpoint.
+     */
+    bool ReverseDebugger::reverseContinue(const StopCondition& stop)
+    {
+        boost::uint64_t end = now();
+
+        while (!_checkpoints.empty())
+        {
+            size_t index = _checkpoints.size() - 1;
+            while (index > 0 && _checkpoints[index].registers.instructions >= end) --index;
+
+            boost::uint64_t start = _checkpoints[index].registers.instructions;
+            if (start >= end) break;
+
+            restore(index);
+
+            bool found = false;
+            boost::uint64_t hit = 0;
+
+            while (now() < end)
+            {
+                if (stop(_cpu))
+                {
+                    found = true;
+                    hit = now();
+                }
+                if (run(1) == 0) break;
+            }
+
+            if (found) return seek(hit);
+            if (index == 0) break;
+            end = start;
+        }
+
+        seek(_checkpoints.front().registers.instructions);
+        return false;
+    }
+
+    boost::uint64_t ReverseDebugger::now() const
+    {
+        return _cpu.instructionCount();
+    }
+
+    size_t ReverseDebugger::hostCallsNow() const
+    {
+        return _recorder->hostCallCount() - (_replayer ? _replayer->remainingHostCalls() : 0);
+    }
+
+    void ReverseDebugger::takeCheckpoint()
+    {
+        if (!_checkpoints.empty()) _cpu.memory()->takePageImages(_checkpoints.back().undo);
+
+        _checkpoints.push_back(Checkpoint());
+        _cpu.saveSnapshot(_checkpoints.back().registers, false);
+        _checkpoints.back().hostCalls = hostCallsNow();
+
+        updateUsage();
+        if (_used > _budget) thin();
+    }
+
+    /**
+     * @brief Brings the CPU and the memory back to checkpoint index; the 
+     * later checkpoints are dropped and recreated when running forward.
+     */
+    void ReverseDebugger::restore(size_t index)
+    {
+        Memory& memory = *_cpu.memory();
+        std::vector<PageImage> live;
+
+        memory.takePageImages(live);
+        memory.restorePages(live);
+
+        for (size_t i = _checkpoints.size() - 1; i-- > index; )
+            memory.restorePages(_checkpoints[i].undo);
+
+        _checkpoints.resize(index + 1);
+        _checkpoints.back().undo.clear();
+        memory.trackPages();
+
+        const Checkpoint& checkpoint = _checkpoints.back();
+        _cpu.restoreSnapshot(checkpoint.registers);
+
+        _cpu.attachRecorder(boost::shared_ptr<Recorder>());
+        _replayer.reset(new Replayer(*_recorder, checkpoint.hostCalls, checkpoint.registers.instructions));
+        _cpu.attachReplayer(_replayer);
+
+        if (now() >= _present) goLive();
+        updateUsage();
+    }
+
+    /**
+     * @brief Drops every other checkpoint (never the first and the last) 
+     * and doubles the interval.
+     */
+    void ReverseDebugger::thin()
+    {
+        std::vector<Checkpoint> kept;
+        kept.reserve(_checkpoints.size() / 2 + 2);
+
+        for (size_t i = 0; i < _checkpoints.size(); ++i)
+        {
+            if (i % 2 == 0 || i == _checkpoints.size() - 1)
+            {
+                kept.push_back(Checkpoint());
+                std::swap(kept.back(), _checkpoints[i]);
+                continue;
+            }
+
+            // a page not written in the previous interval was the same at this checkpoint
+            std::vector<PageImage>& into = kept.back().undo;
+            std::set<uint32> pages;
+            for (size_t p = 0; p < into.size(); ++p) pages.insert(into[p].page);
+
+            for (size_t p = 0; p < _checkpoints[i].undo.size(); ++p)
+            {
+                if (pages.count(_checkpoints[i].undo[p].page)) continue;
+                into.push_back(PageImage());
+                std::swap(into.back(), _checkpoints[i].undo[p]);
+            }
+        }
+
+        _checkpoints.swap(kept);
+        _interval *= 2;
+        updateUsage();
+    }
+
+    void ReverseDebugger::goLive()
+    {
+        _cpu.attachReplayer(boost::shared_ptr<Replayer>());
+        _replayer.reset();
+        _cpu.attachRecorder(_recorder);
+    }
+
+    void ReverseDebugger::updateUsage()
+    {
+        _used = 0;
+        for (size_t i = 0; i < _checkpoints.size(); ++i)
+        {
+            _used += sizeof(Checkpoint);
+            for (size_t p = 0; p < _checkpoints[i].undo.size(); ++p)
+                _used += sizeof(PageImage) + _checkpoints[i].undo[p].words.size() * sizeof(uint32);
+        }
+    }
+
+} // tememu
@@ -0,0 +1,116 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _REVERSE_H
+#define _REVERSE_H
+
+#include "memory.h"
+#include "replay.h"
+#include "snapshot.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace tememu
+{
+    class MipsCPU;
+
+    /**
+     * @brief Reverse execution for one CPU, by checkpoints and re-execution.
+     *
+     * Every interval() instructions a checkpoint saves the registers; the 
+     * memory tracks the pages written in the interval and keeps their old
+     * contents. Going back to an instruction restores the nearest earlier
+     * checkpoint by undoing the page changes, then runs forward to it. 
+     * Host calls are recorded in memory while running live and replayed
+     * during re-execution, so the host is only asked once.
+     *
+     * When the checkpoints exceed the memory budget, every other one is 
+     * dropped (its pages are merged into the previous one) and the 
+     * interval doubles.
+     *
+     * Run the CPU through run() only while the debugger is attached. Host
+     * calls must not block, and the memory must not be shared with other
+     * running cores.
+     */
+    class ReverseDebugger : boost::noncopyable
+    {
+    public:
+        // true at the instruction to stop before
+        typedef boost::function<bool (const MipsCPU&)> StopCondition;
+
+        static const size_t default_budget = 64 * 1024 * 1024;
+        static const boost::uint64_t default_interval = 100 * 1000;
+
+        ReverseDebugger(MipsCPU& cpu, size_t memoryBudget = default_budget,
+            boost::uint64_t interval = default_interval);
+        ~ReverseDebugger();
+
+        int run(int budget);
+        bool seek(boost::uint64_t instruction);
+        bool reverseStep();
+        bool reverseContinue(const StopCondition& stop);
+
+        boost::uint64_t interval() const { return _interval; }
+        size_t checkpointCount() const { return _checkpoints.size(); }
+        size_t memoryUsed() const { return _used; }
+
+    private:
+        struct Checkpoint
+        {
+            Snapshot registers;
+            size_t hostCalls;
+            // the pages written after this checkpoint, as they were at it
+            std::vector<PageImage> undo;
+        };
+
+        boost::uint64_t now() const;
+        size_t hostCallsNow() const;
+        void takeCheckpoint();
+        void restore(size_t index);
+        void thin();
+        void goLive();
+        void updateUsage();
+
+    private:
+        MipsCPU& _cpu;
+        size_t _budget;
+        boost::uint64_t _interval;
+        std::vector<Checkpoint> _checkpoints;
+        size_t _used;
+
+        boost::shared_ptr<Recorder> _recorder;
+        // set while re-executing recorded history
+        boost::shared_ptr<Replayer> _replayer;
+        // the furthest point reached by live execution
+        boost::uint64_t _present;
+    };
+
+} // tememu
+
+#endif //include guard
@@ -0,0 +1,171 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "scheduler.h"
+
+#include <boost/bind.hpp>
+
+namespace tememu 
+{
+    Scheduler::Scheduler(int threadCount, int quantum)
+        : _quantum(quantum), _stopping(false)
+    {
+        for (int i = 0; i < threadCount; ++i)
+            _workers.create_thread(boost::bind(&Scheduler::workerLoop, this));
+    }
+
+    Scheduler::~Scheduler()
+    {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _stopping = true;
+        }
+        _runnable.notify_all();
+        _workers.join_all();
+    }
+
+    void Scheduler::spawn(Context context)
+    {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _runQueue.push_back(context);
+        }
+        _runnable.notify_one();
+    }
+
+    /**
+     * @brief Makes a context blocked on a host call runnable again.
+     *
+     * The host should store the results of the call in the guest registers
+     * before waking the context. Waking a context that has not been parked
+     * yet (because its worker is still finishing the quantum) is remembered
+     * until the quantum ends; it only counts if the quantum ends blocked.
+     * Waking a context that is neither running nor parked does nothing.
+     */
+    void Scheduler::wake(Context context)
+    {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+
+            if (_parked.erase(context) == 0)
+            {
+                if (_running.count(context)) _earlyWakes.insert(context);
+                return;
+            }
+
+            context->unblock();
+            _runQueue.push_back(context);
+        }
+        _runnable.notify_one();
+    }
+
+    /**
+     * @brief Waits until no context is runnable, i.e. every context has 
+     * either finished or is blocked on a host call.
+     */
+    void Scheduler::waitIdle()
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+
+        while (!_runQueue.empty() || !_running.empty())
+            _idle.wait(lock);
+    }
+
+    /**
+     * @brief The number of contexts that have not finished yet.
+     */
+    size_t Scheduler::contextCount() const
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _runQueue.size() + _parked.size() + _running.size();
+    }
+
+    /**
+     * @brief The contexts that threw while running, with what they threw.
+     */
+    Scheduler::Faults Scheduler::faults() const
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _faults;
+    }
+
+    void Scheduler::workerLoop()
+    {
+        boost::mutex::scoped_lock lock(_mutex);
+
+        for (;;)
+        {
+            while (_runQueue.empty() && !_stopping)
+                _runnable.wait(lock);
+
+            if (_stopping) return;
+
+            Context context = _runQueue.front();
+            _runQueue.pop_front();
+            _running.insert(context);
+
+            boost::exception_ptr error;
+
+            lock.unlock();
+            try
+            {
+                context->stepProgram(_quantum);
+            }
+            catch (...)
+            {
+                error = boost::current_exception();
+            }
+            lock.lock();
+
+            _running.erase(context);
+            // a wake only answers a host call that blocked this quantum
+            bool woken = _earlyWakes.erase(context) != 0;
+
+            if (error)
+            {
+                _faults[context] = error;
+            }
+            else if (context->blocked())
+            {
+                if (woken)
+                {
+                    context->unblock();
+                    _runQueue.push_back(context);
+                }
+                else
+                {
+                    _parked.insert(context);
+                }
+            }
+            else if (!context->halted())
+            {
+                _runQueue.push_back(context);
+            }
+
+            if (_runQueue.empty() && _running.empty())
+                _idle.notify_all();
+        }
+    }
+
+} // tememu
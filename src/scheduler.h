@@ -0,0 +1,97 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include "mipscpu.h"
+
+#include <boost/exception_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <map>
+#include <set>
+
+namespace tememu 
+{
+    /**
+     * @brief Multiplexes many guest contexts onto a small pool of host threads.
+     *
+     * A context is a MipsCPU (which holds its memory handle). Workers take
+     * the next runnable context, run it for one quantum and put it back at
+     * the end of the run queue. A context whose host call handler returns
+     * false is parked until wake() is called for it; a context whose PC
+     * leaves the text is retired. A context whose quantum throws is retired
+     * as faulted, with the exception kept for faults(); the others go on.
+     *
+     * The guest state is already fully explicit in MipsCPU, so there is no
+     * need for coroutine or fiber stacks: resuming a context is simply
+     * calling stepProgram on it again.
+     */
+    class Scheduler : boost::noncopyable
+    {
+    public:
+        typedef boost::shared_ptr<MipsCPU> Context;
+
+        Scheduler(int threadCount, int quantum);
+        ~Scheduler();
+
+        void spawn(Context context);
+        void wake(Context context);
+        void waitIdle();
+
+        int quantum() const { return _quantum; }
+        size_t contextCount() const;
+
+        typedef std::map<Context, boost::exception_ptr> Faults;
+        Faults faults() const;
+
+    private:
+        void workerLoop();
+
+    private:
+        const int _quantum;
+
+        mutable boost::mutex _mutex;
+        boost::condition_variable _runnable;
+        boost::condition_variable _idle;
+
+        std::deque<Context> _runQueue;
+        std::set<Context> _parked;
+        std::set<Context> _running;
+        std::set<Context> _earlyWakes;  // woken while still running their quantum
+        Faults _faults;
+        bool _stopping;
+
+        boost::thread_group _workers;
+    };
+
+} // tememu
+
+#endif //include guard
@@ -0,0 +1,172 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "smp.h"
+
+#include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace tememu 
+{
+    namespace
+    {
+        void runCore(MipsCPU* cpu, boost::exception_ptr* error)
+        {
+            try
+            {
+                cpu->runProgram();
+            }
+            catch (...)
+            {
+                *error = boost::current_exception();
+            }
+        }
+
+        /**
+         * @brief Runs one core quantum by quantum. Each quantum is started
+         * and finished on the barrier, shared with the coordinating thread.
+         */
+        void runCoreQuanta(MipsCPU* cpu, int quantum, boost::barrier* barrier,
+                           const bool* done, boost::exception_ptr* error)
+        {
+            for (;;)
+            {
+                barrier->wait();
+                if (*done) return;
+
+                try
+                {
+                    if (!*error) cpu->stepProgram(quantum);
+                }
+                catch (...)
+                {
+                    *error = boost::current_exception();
+                }
+
+                barrier->wait();
+            }
+        }
+    }
+
+    SmpSystem::SmpSystem(int coreCount, size_t memorySize)
+        : _memory(new Memory(memorySize))
+    {
+        for (int i = 0; i < coreCount; ++i)
+        {
+            boost::shared_ptr<MipsCPU> cpu(new MipsCPU);
+            cpu->attachMemory(_memory);
+            _cores.push_back(cpu);
+        }
+    }
+
+    void SmpSystem::loadProgram(boost::shared_ptr< std::vector<int32> > program)
+    {
+        _memory->loadProgram(*program);
+    }
+
+    /**
+     * @brief Runs every core on its own thread until all of them leave the text.
+     *
+     * An exception thrown by a core is rethrown here after all threads joined.
+     */
+    void SmpSystem::run()
+    {
+        std::vector<boost::exception_ptr> errors(_cores.size());
+        boost::thread_group threads;
+
+        for (size_t i = 0; i < _cores.size(); ++i)
+            threads.create_thread(boost::bind(&runCore, _cores[i].get(), &errors[i]));
+
+        threads.join_all();
+
+        for (size_t i = 0; i < errors.size(); ++i)
+            if (errors[i]) boost::rethrow_exception(errors[i]);
+    }
+
+    /**
+     * @brief Runs the cores in lockstep quanta until each of them halted or
+     * is blocked on a host call, or a stop is requested on any of them.
+     */
+    void SmpSystem::runDeterministic(int quantum)
+    {
+        std::vector<StoreBuffer> buffers(_cores.size());
+        std::vector<boost::exception_ptr> errors(_cores.size());
+        boost::barrier barrier(static_cast<unsigned>(_cores.size() + 1));
+        bool done = false;
+        boost::thread_group threads;
+
+        for (size_t i = 0; i < _cores.size(); ++i)
+        {
+            _cores[i]->setStoreBuffer(&buffers[i]);
+            threads.create_thread(boost::bind(&runCoreQuanta, _cores[i].get(), 
+                quantum, &barrier, &done, &errors[i]));
+        }
+
+        while (!done)
+        {
+            barrier.wait(); // start the quantum
+            barrier.wait(); // every core finished it
+
+            bool stop = false, idle = true;
+
+            for (size_t i = 0; i < _cores.size(); ++i)
+            {
+                buffers[i].commit(*_memory);
+                if (errors[i]) stop = true;
+            }
+
+            for (size_t i = 0; i < _cores.size() && !stop; ++i)
+            {
+                MipsCPU& cpu = *_cores[i];
+
+                try
+                {
+                    if (cpu.atSyncPoint()) cpu.completeSyncPoint();
+                }
+                catch (...)
+                {
+                    errors[i] = boost::current_exception();
+                    stop = true;
+                }
+
+                if (cpu.pollEvents()) stop = true;
+                if (!cpu.halted() && !cpu.blocked()) idle = false;
+            }
+
+            done = stop || idle;
+        }
+
+        barrier.wait(); // release the threads
+        threads.join_all();
+
+        for (size_t i = 0; i < _cores.size(); ++i)
+        {
+            _cores[i]->setStoreBuffer(0);
+            if (errors[i]) boost::rethrow_exception(errors[i]);
+        }
+    }
+
+} // tememu
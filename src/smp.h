@@ -0,0 +1,73 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _SMP_H
+#define _SMP_H
+
+#include "memory.h"
+#include "mipscpu.h"
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace tememu 
+{
+    /**
+     * @brief A set of cores sharing one guest memory.
+     *
+     * Every core runs on its own host thread. The cores start with identical
+     * state; give them distinct registers (e.g. a core id in $a0) before
+     * calling run() if the program needs to tell them apart.
+     *
+     * runDeterministic trades some speed for reproducibility: the cores 
+     * still run in parallel, but only for a fixed quantum at a time, with
+     * their stores kept private until a barrier, where they are committed
+     * in core order. sc and sync end a core's quantum early and are 
+     * executed at the barrier, also in core order. Pending interrupts and
+     * stop requests are only picked up at barriers. The result depends 
+     * only on the program, the initial state and the quantum.
+     */
+    class SmpSystem : boost::noncopyable
+    {
+    public:
+        SmpSystem(int coreCount, size_t memorySize);
+
+        void loadProgram(boost::shared_ptr< std::vector<int32> > program);
+        void run();
+        void runDeterministic(int quantum);
+
+        int coreCount() const { return static_cast<int>(_cores.size()); }
+        MipsCPU& core(int index) { return *_cores[index]; }
+        boost::shared_ptr<Memory> memory() const { return _memory; }
+
+    private:
+        boost::shared_ptr<Memory> _memory;
+        std::vector< boost::shared_ptr<MipsCPU> > _cores;
+    };
+
+} // tememu
+
+#endif //include guard
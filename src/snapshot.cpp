@@ -0,0 +1,117 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "snapshot.h"
+
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+namespace tememu
+{
+    namespace
+    {
+        const char snapshot_magic[8] = { 'T', 'M', 'S', 'N', 'A', 'P', 0, 0 };
+        const boost::uint32_t snapshot_version = 3;
+
+        template <typename T>
+        void put(std::ostream& os, const T* data, size_t count)
+        {
+            os.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+        }
+
+        template <typename T>
+        void get(std::istream& is, T* data, size_t count)
+        {
+            if (!is.read(reinterpret_cast<char*>(data), count * sizeof(T)))
+                throw std::runtime_error("Snapshot: truncated snapshot");
+        }
+    }
+
+    /**
+     * @brief Writes the snapshot in host byte order.
+     */
+    void Snapshot::write(std::ostream& os) const
+    {
+        boost::uint64_t words = memory.size();
+
+        put(os, snapshot_magic, sizeof(snapshot_magic));
+        put(os, &snapshot_version, 1);
+        put(os, gpr, gpr_count);
+        put(os, fpr, fpr_count);
+        put(os, fcr, fcr_count);
+        put(os, &hi, 1);
+        put(os, &lo, 1);
+        put(os, &pc, 1);
+        put(os, &npc, 1);
+        put(os, &fcsr, 1);
+        put(os, &interruptLines, 1);
+        put(os, &instructions, 1);
+        put(os, &status, 1);
+        put(os, &cause, 1);
+        put(os, &epc, 1);
+        put(os, &badVAddr, 1);
+        put(os, &count, 1);
+        put(os, &compare, 1);
+        put(os, &textEnd, 1);
+        put(os, &words, 1);
+        if (words) put(os, &memory[0], memory.size());
+    }
+
+    void Snapshot::read(std::istream& is)
+    {
+        char magic[sizeof(snapshot_magic)];
+        boost::uint32_t version;
+        boost::uint64_t words;
+
+        get(is, magic, sizeof(magic));
+        get(is, &version, 1);
+        if (std::memcmp(magic, snapshot_magic, sizeof(magic)) != 0 || version != snapshot_version)
+            throw std::runtime_error("Snapshot: not a snapshot");
+
+        get(is, gpr, gpr_count);
+        get(is, fpr, fpr_count);
+        get(is, fcr, fcr_count);
+        get(is, &hi, 1);
+        get(is, &lo, 1);
+        get(is, &pc, 1);
+        get(is, &npc, 1);
+        get(is, &fcsr, 1);
+        get(is, &interruptLines, 1);
+        get(is, &instructions, 1);
+        get(is, &status, 1);
+        get(is, &cause, 1);
+        get(is, &epc, 1);
+        get(is, &badVAddr, 1);
+        get(is, &count, 1);
+        get(is, &compare, 1);
+        get(is, &textEnd, 1);
+        get(is, &words, 1);
+
+        memory.resize(static_cast<size_t>(words));
+        if (words) get(is, &memory[0], memory.size());
+    }
+
+} // tememu
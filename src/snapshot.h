@@ -0,0 +1,64 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include "consts.h"
+
+#include <boost/cstdint.hpp>
+
+#include <iosfwd>
+#include <vector>
+
+namespace tememu
+{
+    /**
+     * @brief The complete state of a MipsCPU and its memory.
+     *
+     * Taken by MipsCPU::saveSnapshot and put back by restoreSnapshot. A
+     * snapshot can be stored in a file, e.g. as the starting point of a 
+     * replay log. The LL/SC reservation is not part of it.
+     */
+    struct Snapshot
+    {
+        boost::int32_t gpr[gpr_count];
+        boost::int32_t fpr[fpr_count];
+        boost::int32_t fcr[fcr_count];
+        boost::int32_t hi, lo, pc, npc, fcsr;
+        boost::uint32_t interruptLines;
+        boost::uint64_t instructions;
+        // COP0
+        boost::uint32_t status, cause, epc, badVAddr, count, compare;
+
+        boost::uint32_t textEnd;
+        std::vector<boost::uint32_t> memory;
+
+        void write(std::ostream& os) const;
+        void read(std::istream& is);
+    };
+
+} // tememu
+
+#endif //include guard
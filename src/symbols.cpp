@@ -0,0 +1,75 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "symbols.h"
+
+#include <cstdio>
+#include <sstream>
+
+namespace tememu 
+{
+    /**
+     * @brief Reads symbols in the format printed by nm: "address [type] name",
+     * with a hexadecimal address. Lines that do not parse are skipped.
+     */
+    void SymbolTable::load(std::istream& is)
+    {
+        std::string line;
+
+        while (std::getline(is, line))
+        {
+            std::istringstream fields(line);
+            std::string addr, type, name;
+
+            if (!(fields >> addr >> type)) continue;
+            if (!(fields >> name)) name = type;
+
+            std::istringstream hex(addr);
+            boost::uint32_t value;
+            if (hex >> std::hex >> value) add(value, name);
+        }
+    }
+
+    /**
+     * @brief The name of the symbol containing addr (the closest one at or
+     * below it), or an empty string.
+     */
+    std::string SymbolTable::lookup(boost::uint32_t addr) const
+    {
+        const_iterator it = _symbols.upper_bound(addr);
+        if (it == _symbols.begin()) return std::string();
+        return (--it)->second;
+    }
+
+    std::string SymbolTable::nameOrAddress(boost::uint32_t addr) const
+    {
+        std::string name = lookup(addr);
+        if (!name.empty()) return name;
+
+        char buffer[16];
+        std::sprintf(buffer, "0x%x", addr);
+        return buffer;
+    }
+
+} // tememu
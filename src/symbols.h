@@ -0,0 +1,59 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _SYMBOLS_H
+#define _SYMBOLS_H
+
+#include <boost/cstdint.hpp>
+
+#include <istream>
+#include <map>
+#include <string>
+
+namespace tememu 
+{
+    /**
+     * @brief Guest symbols, mapping addresses to function names.
+     */
+    class SymbolTable
+    {
+    public:
+        void add(boost::uint32_t addr, const std::string& name) { _symbols[addr] = name; }
+        void load(std::istream& is);
+
+        bool empty() const { return _symbols.empty(); }
+        std::string lookup(boost::uint32_t addr) const;
+        std::string nameOrAddress(boost::uint32_t addr) const;
+
+        typedef std::map<boost::uint32_t, std::string>::const_iterator const_iterator;
+        const_iterator begin() const { return _symbols.begin(); }
+        const_iterator end() const { return _symbols.end(); }
+
+    private:
+        std::map<boost::uint32_t, std::string> _symbols;
+    };
+
+} // tememu
+
+#endif //include guard
@@ -0,0 +1,185 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#include "tracebuffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace tememu 
+{
+    namespace
+    {
+        const char trace_magic[8] = { 'T', 'M', 'T', 'R', 'A', 'C', 'E', 0 };
+        const boost::uint32_t trace_version = 1;
+
+        size_t roundUpToPowerOfTwo(size_t n)
+        {
+            size_t result = 1;
+            while (result < n) result <<= 1;
+            return result;
+        }
+    }
+
+    const boost::uint8_t TraceBuffer::no_register;
+    const boost::uint32_t TraceBuffer::flag_registers;
+
+    /**
+     * @brief Creates an anonymous (in-process) buffer.
+     */
+    TraceBuffer::TraceBuffer(size_t capacity, bool recordRegisters)
+        : _mapping(MAP_FAILED), _mappingSize(0), _header(0), _records(0), _mask(0)
+    {
+        map(-1, capacity, true, recordRegisters);
+    }
+
+    /**
+     * @brief Creates (or truncates) path and maps the buffer onto it.
+     */
+    TraceBuffer::TraceBuffer(const std::string& path, size_t capacity, bool recordRegisters)
+        : _mapping(MAP_FAILED), _mappingSize(0), _header(0), _records(0), _mask(0)
+    {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw std::runtime_error("TraceBuffer: cannot create " + path);
+
+        try
+        {
+            map(fd, capacity, true, recordRegisters);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+
+        ::close(fd);
+    }
+
+    TraceBuffer::TraceBuffer()
+        : _mapping(MAP_FAILED), _mappingSize(0), _header(0), _records(0), _mask(0)
+    {
+    }
+
+    TraceBuffer::~TraceBuffer()
+    {
+        if (_mapping != MAP_FAILED) munmap(_mapping, _mappingSize);
+    }
+
+    /**
+     * @brief Maps an existing trace file read-only, for decoding.
+     */
+    boost::shared_ptr<TraceBuffer> TraceBuffer::open(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("TraceBuffer: cannot open " + path);
+
+        boost::shared_ptr<TraceBuffer> buffer(new TraceBuffer);
+
+        try
+        {
+            buffer->map(fd, 0, false, false);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+
+        ::close(fd);
+        return buffer;
+    }
+
+    void TraceBuffer::map(int fd, size_t capacity, bool create, bool recordRegisters)
+    {
+        if (create)
+        {
+            capacity = roundUpToPowerOfTwo(std::max<size_t>(capacity, 1));
+            _mappingSize = sizeof(Header) + capacity * sizeof(TraceRecord);
+
+            if (fd >= 0 && ftruncate(fd, _mappingSize) != 0)
+                throw std::runtime_error("TraceBuffer: cannot resize the trace file");
+
+            _mapping = fd >= 0
+                ? mmap(0, _mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                : mmap(0, _mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (_mapping == MAP_FAILED) throw std::runtime_error("TraceBuffer: mmap failed");
+
+            _header = static_cast<Header*>(_mapping);
+            std::memcpy(_header->magic, trace_magic, sizeof(trace_magic));
+            _header->version = trace_version;
+            _header->flags = recordRegisters ? flag_registers : 0;
+            _header->capacity = capacity;
+            new (&_header->head) boost::atomic<boost::uint64_t>(0);
+        }
+        else
+        {
+            struct stat st;
+            if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header))
+                throw std::runtime_error("TraceBuffer: not a trace file");
+
+            _mappingSize = st.st_size;
+            _mapping = mmap(0, _mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (_mapping == MAP_FAILED) throw std::runtime_error("TraceBuffer: mmap failed");
+
+            _header = static_cast<Header*>(_mapping);
+            capacity = _header->capacity;
+
+            if (std::memcmp(_header->magic, trace_magic, sizeof(trace_magic)) != 0 ||
+                _header->version != trace_version ||
+                capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+                _mappingSize < sizeof(Header) + capacity * sizeof(TraceRecord))
+            {
+                throw std::runtime_error("TraceBuffer: not a trace file");
+            }
+        }
+
+        _records = reinterpret_cast<TraceRecord*>(_header + 1);
+        _mask = capacity - 1;
+    }
+
+    /**
+     * @brief The number of records held, at most capacity().
+     */
+    size_t TraceBuffer::size() const
+    {
+        return static_cast<size_t>(std::min<boost::uint64_t>(written(), capacity()));
+    }
+
+    /**
+     * @brief The index-th oldest record still in the buffer.
+     */
+    TraceRecord TraceBuffer::record(size_t index) const
+    {
+        boost::uint64_t oldest = written() - size();
+        return _records[(oldest + index) & _mask];
+    }
+
+} // tememu
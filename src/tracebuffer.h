@@ -0,0 +1,117 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+#ifndef _TRACEBUFFER_H
+#define _TRACEBUFFER_H
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace tememu 
+{
+    /**
+     * @brief One retired instruction. reg is 0xFF if no register was recorded.
+     */
+    struct TraceRecord
+    {
+        boost::uint32_t pc;
+        boost::uint32_t instr;
+        boost::uint32_t value;
+        boost::uint8_t reg;
+        boost::uint8_t reserved[3];
+    };
+
+    /**
+     * @brief Fixed size ring buffer of the most recently retired instructions.
+     *
+     * The buffer is a single mapping: a header followed by a power of two
+     * number of records. When backed by a file the mapping is shared, so 
+     * the file holds the last N instructions even if the process dies, and
+     * it can be decoded offline with the tracedump tool.
+     *
+     * There is one writer (the CPU the buffer is attached to). It fills
+     * the record, then publishes it by bumping the head with a release 
+     * store; readers never block it.
+     */
+    class TraceBuffer : boost::noncopyable
+    {
+    public:
+        static const boost::uint8_t no_register = 0xFF;
+
+        TraceBuffer(size_t capacity, bool recordRegisters);
+        TraceBuffer(const std::string& path, size_t capacity, bool recordRegisters);
+        ~TraceBuffer();
+
+        static boost::shared_ptr<TraceBuffer> open(const std::string& path);
+
+        void append(boost::uint32_t pc, boost::uint32_t instr, int reg, boost::uint32_t value)
+        {
+            boost::uint64_t head = _header->head.load(boost::memory_order_relaxed);
+            TraceRecord& record = _records[head & _mask];
+
+            record.pc = pc;
+            record.instr = instr;
+            record.reg = reg < 0 ? no_register : static_cast<boost::uint8_t>(reg);
+            record.value = value;
+
+            _header->head.store(head + 1, boost::memory_order_release);
+        }
+
+        bool recordsRegisters() const { return _header->flags & flag_registers; }
+        size_t capacity() const { return _mask + 1; }
+        boost::uint64_t written() const { return _header->head.load(boost::memory_order_acquire); }
+        size_t size() const;
+        TraceRecord record(size_t index) const;
+
+    private:
+        struct Header
+        {
+            char magic[8];
+            boost::uint32_t version;
+            boost::uint32_t flags;
+            boost::uint64_t capacity;
+            boost::atomic<boost::uint64_t> head;
+            char reserved[32];
+        };
+
+        static const boost::uint32_t flag_registers = 1;
+
+        TraceBuffer();
+        void map(int fd, size_t capacity, bool create, bool recordRegisters);
+
+    private:
+        void* _mapping;
+        size_t _mappingSize;
+        Header* _header;
+        TraceRecord* _records;
+        size_t _mask;
+    };
+
+} // tememu
+
+#endif //include guard
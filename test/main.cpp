@@ -22,17 +22,37 @@
  *    THE SOFTWARE.
  */
 
+#include <boost/asio.hpp>
 #include <boost/cstdint.hpp>
+#include <boost/thread/thread.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <bitset>
+#include <climits>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 
+#include "../src/coverage.h"
+#include "../src/cpupool.h"
+#include "../src/disasm.h"
+#include "../src/gdbstub.h"
 #include "../src/mipscpu.h"
+#include "../src/profiler.h"
+#include "../src/replay.h"
+#include "../src/reverse.h"
+#include "../src/scheduler.h"
+#include "../src/smp.h"
+#include "../src/tracebuffer.h"
 #include "gtest/gtest.h"
 
-typedef boost::int_fast32_t int32;
+typedef boost::int32_t int32;
 
 inline void loadMipsBinDump(const std::string& fileName, boost::shared_ptr< std::vector<int32> > data)
 {
@@ -258,6 +278,171 @@ TEST(SimpleProgs, Divu1)
     EXPECT_EQ(cpu.lo(), 3);
 }
 
+TEST(SimpleProgs, multiply_family)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x01090018); // mult $t0, $t1
+    program->push_back(0x00008010); // mfhi $s0
+    program->push_back(0x00008812); // mflo $s1
+    program->push_back(0x01090019); // multu $t0, $t1
+    program->push_back(0x00009010); // mfhi $s2
+    program->push_back(0x00009812); // mflo $s3
+    program->push_back(0x71080000); // madd $t0, $t0
+    program->push_back(0x0000a010); // mfhi $s4
+    program->push_back(0x0000a812); // mflo $s5
+    program->push_back(0x71290005); // msubu $t1, $t1
+    program->push_back(0x0000b010); // mfhi $s6
+    program->push_back(0x0000b812); // mflo $s7
+    program->push_back(0x71091002); // mul $v0, $t0, $t1
+
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    cpu.setGPR(8, -3);
+    cpu.setGPR(9, 0x7fffffff);
+    cpu.runProgram();
+
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(16)), 0xfffffffeu);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(17)), 0x80000003u);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(18)), 0x7ffffffdu);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(19)), 0x80000003u);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(20)), 0x7ffffffdu);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(21)), 0x8000000cu);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(22)), 0x3ffffffeu);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(23)), 0x8000000bu);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(2)), 0x80000003u);
+    // mul leaves HI and LO alone
+    EXPECT_EQ(boost::uint32_t(cpu.hi()), 0x3ffffffeu);
+}
+
+TEST(SimpleProgs, division_edge_cases)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x0100001a); // div $t0, $zero
+    program->push_back(0x00008010); // mfhi $s0
+    program->push_back(0x00008812); // mflo $s1
+    program->push_back(0x012a001a); // div $t1, $t2
+    program->push_back(0x00009010); // mfhi $s2
+    program->push_back(0x00009812); // mflo $s3
+    program->push_back(0x0120001b); // divu $t1, $zero
+    program->push_back(0x0000a010); // mfhi $s4
+    program->push_back(0x0000a812); // mflo $s5
+    program->push_back(0x012b001b); // divu $t1, $t3
+    program->push_back(0x0000b010); // mfhi $s6
+    program->push_back(0x0000b812); // mflo $s7
+
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    cpu.setGPR(8, 7);
+    cpu.setGPR(9, INT_MIN);
+    cpu.setGPR(10, -1);
+    cpu.setGPR(11, 7);
+    cpu.runProgram();
+
+    // no SIGFPE, and defined results
+    EXPECT_EQ(cpu.gprValue(16), 7);
+    EXPECT_EQ(cpu.gprValue(17), -1);
+    EXPECT_EQ(cpu.gprValue(18), 0);
+    EXPECT_EQ(cpu.gprValue(19), INT_MIN);
+    EXPECT_EQ(cpu.gprValue(20), INT_MIN);
+    EXPECT_EQ(cpu.gprValue(21), -1);
+    // divu is unsigned
+    EXPECT_EQ(cpu.gprValue(22), 2);
+    EXPECT_EQ(cpu.gprValue(23), 0x12492492);
+}
+
+TEST(SimpleProgs, shifts_and_set_on_less_than)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x00088100); // sll $s0, $t0, 4
+    program->push_back(0x00088f02); // srl $s1, $t0, 28
+    program->push_back(0x00089703); // sra $s2, $t0, 28
+    program->push_back(0x01289804); // sllv $s3, $t0, $t1
+    program->push_back(0x0128a006); // srlv $s4, $t0, $t1
+    program->push_back(0x0128a807); // srav $s5, $t0, $t1
+    program->push_back(0x0109b02a); // slt $s6, $t0, $t1
+    program->push_back(0x0109b82b); // sltu $s7, $t0, $t1
+    program->push_back(0x2902ffff); // slti $v0, $t0, -1
+    program->push_back(0x2d23ffff); // sltiu $v1, $t1, -1
+
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    cpu.setGPR(8, 0x87654321);
+    cpu.setGPR(9, 36); // variable shifts use the low five bits
+    cpu.runProgram();
+
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(16)), 0x76543210u);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(17)), 0x8u);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(18)), 0xfffffff8u);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(19)), 0x76543210u);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(20)), 0x08765432u);
+    EXPECT_EQ(boost::uint32_t(cpu.gprValue(21)), 0xf8765432u);
+    EXPECT_EQ(cpu.gprValue(22), 1);
+    EXPECT_EQ(cpu.gprValue(23), 0);
+    EXPECT_EQ(cpu.gprValue(2), 1);
+    EXPECT_EQ(cpu.gprValue(3), 1);
+}
+
+TEST(SimpleProgs, floating_point)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0xc4000400); // lwc1 $f0, 0x400($zero)
+    program->push_back(0xc4010404); // lwc1 $f1, 0x404($zero)
+    program->push_back(0x46010080); // add.s $f2, $f0, $f1
+    program->push_back(0x460210c2); // mul.s $f3, $f2, $f2
+    program->push_back(0xe4030408); // swc1 $f3, 0x408($zero)
+    program->push_back(0x46001921); // cvt.d.s $f4, $f3
+    program->push_back(0x46242180); // add.d $f6, $f4, $f4
+    program->push_back(0x46203224); // cvt.w.d $f8, $f6
+    program->push_back(0x44104000); // mfc1 $s0, $f8
+    program->push_back(0x4600083c); // c.lt.s $f1, $f0
+    program->push_back(0x45010002); // bc1t skip
+    program->push_back(0x00000000); // nop
+    program->push_back(0x20110001); // addi $s1, $zero, 1
+    program->push_back(0x4601003c); // c.lt.s $f0, $f1
+    program->push_back(0x45000002); // bc1f skip2
+    program->push_back(0x00000000); // nop
+    program->push_back(0x20120001); // addi $s2, $zero, 1
+    program->push_back(0x20080002); // addi $t0, $zero, 2
+    program->push_back(0x44c8f800); // ctc1 $t0, $31
+    program->push_back(0x46000264); // cvt.w.s $f9, $f0
+    program->push_back(0x44134800); // mfc1 $s3, $f9
+    program->push_back(0x4620328d); // trunc.w.d $f10, $f6
+    program->push_back(0x44145000); // mfc1 $s4, $f10
+    program->push_back(0x4455f800); // cfc1 $s5, $31
+    program->push_back(0x44946000); // mtc1 $s4, $f12
+    program->push_back(0x46806360); // cvt.s.w $f13, $f12
+    program->push_back(0x46006b47); // neg.s $f13, $f13
+    program->push_back(0xe40d040c); // swc1 $f13, 0x40c($zero)
+    program->push_back(0x46202384); // sqrt.d $f14, $f4
+    program->push_back(0x46207420); // cvt.s.d $f16, $f14
+    program->push_back(0xe4100410); // swc1 $f16, 0x410($zero)
+
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    cpu.memory()->writeWord(0x400, 0x3fc00000); // 1.5f
+    cpu.memory()->writeWord(0x404, 0x40100000); // 2.25f
+#if defined(__SSE2__)
+    unsigned int mxcsr = _mm_getcsr();
+#endif
+    cpu.runProgram();
+
+    EXPECT_EQ(cpu.memory()->readWord(0x408), 0x41610000u); // 14.0625f
+    EXPECT_EQ(cpu.gprValue(16), 28);
+    EXPECT_EQ(cpu.gprValue(17), 1);
+    EXPECT_EQ(cpu.gprValue(18), 1);
+    // rounds toward +inf after ctc1
+    EXPECT_EQ(cpu.gprValue(19), 2);
+    EXPECT_EQ(cpu.gprValue(20), 28);
+    EXPECT_EQ(cpu.gprValue(21), 2);
+    EXPECT_EQ(cpu.memory()->readWord(0x40c), 0xc1e00000u); // -28.0f
+    EXPECT_EQ(cpu.memory()->readWord(0x410), 0x40700000u); // 3.75f
+    EXPECT_EQ(cpu.fir(), 0x00030000u);
+#if defined(__SSE2__)
+    // the host rounding mode is back
+    EXPECT_EQ(_mm_getcsr() & 0xE000, mxcsr & 0xE000);
+#endif
+}
+
 TEST(Jumping, op_j)
 {
     boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
@@ -269,7 +454,8 @@ TEST(Jumping, op_j)
 
     cpu.runProgram();
 
-    EXPECT_EQ(cpu.gprValue(4), 20);
+    // the addi in the delay slot runs too
+    EXPECT_EQ(cpu.gprValue(4), 22);
 
 }
 
@@ -284,8 +470,8 @@ TEST(Jumping, op_jal)
 
     cpu.runProgram();
 
-    EXPECT_EQ(cpu.gprValue(4), 20);
-    EXPECT_EQ(cpu.gprValue(31), 8);
+    EXPECT_EQ(cpu.gprValue(4), 22);
+    EXPECT_EQ(cpu.gprValue(31), 12); // past the delay slot
 
 }
 
@@ -301,7 +487,33 @@ TEST(Jumping, op_jr)
     cpu.runProgram();
 
     EXPECT_EQ(cpu.gprValue(4), 12);
-    EXPECT_EQ(cpu.gprValue(5), 10);
+    EXPECT_EQ(cpu.gprValue(5), 12);
+}
+
+TEST(Jumping, op_jalr)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x20080014); // addi $t0, $zero, 0x14
+    program->push_back(0x0100f809); // jalr $t0
+    program->push_back(0x20090005); // addi $t1, $zero, 5
+    program->push_back(0x08000007); // j end
+    program->push_back(0x00000000); // nop
+    program->push_back(0x03e08009); // f: jalr $s0, $ra
+    program->push_back(0x01205020); // add $t2, $t1, $zero
+
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    cpu.runProgram();
+
+    // both links point past the delay slot, which ran before the jump
+    EXPECT_EQ(cpu.gprValue(31), 0xc);
+    EXPECT_EQ(cpu.gprValue(16), 0x1c);
+    EXPECT_EQ(cpu.gprValue(10), 5);
+    EXPECT_EQ(cpu.pc(), 0x1cu);
+
+    EXPECT_EQ(tememu::disassemble(0x0100f809, 0), "jalr $t0");
+    EXPECT_EQ(tememu::disassemble(0x03e08009, 0), "jalr $s0, $ra");
+    EXPECT_EQ(tememu::writtenRegister(0x03e08009), 16);
 }
 
 TEST(Jumping, op_bne_true)
@@ -315,7 +527,7 @@ TEST(Jumping, op_bne_true)
 
     cpu.runProgram();
 
-    EXPECT_EQ(cpu.gprValue(4), 10);
+    EXPECT_EQ(cpu.gprValue(4), 13);
     EXPECT_EQ(cpu.gprValue(5), 5);
 }
 
@@ -345,7 +557,7 @@ TEST(Jumping, op_beq_true)
 
     cpu.runProgram();
 
-    EXPECT_EQ(cpu.gprValue(4), 5);
+    EXPECT_EQ(cpu.gprValue(4), 9);
     EXPECT_EQ(cpu.gprValue(5), 5);
 }
 
@@ -364,6 +576,52 @@ TEST(Jumping, op_beq_false)
     EXPECT_EQ(cpu.gprValue(5), 5);
 }
 
+TEST(Jumping, delay_slots)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x20080003); // addi $t0, $zero, 3
+    program->push_back(0x2108ffff); // loop: addi $t0, $t0, -1
+    program->push_back(0x21290001); // addi $t1, $t1, 1
+    program->push_back(0x11000003); // beq $t0, $zero, done
+    program->push_back(0x214a0001); // addi $t2, $t2, 1
+    program->push_back(0x1000fffb); // beq $zero, $zero, loop
+    program->push_back(0x216b0001); // addi $t3, $t3, 1
+    program->push_back(0x0c00000b); // done: jal f
+    program->push_back(0x200c0005); // addi $t4, $zero, 5
+    program->push_back(0x0800000d); // j end
+    program->push_back(0x00000000); // nop
+    program->push_back(0x03e00008); // f: jr $ra
+    program->push_back(0x01806820); // add $t5, $t4, $zero
+
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    cpu.runProgram();
+
+    // every delay slot ran, whether its branch was taken or not
+    EXPECT_EQ(cpu.gprValue(9), 3);
+    EXPECT_EQ(cpu.gprValue(10), 3);
+    EXPECT_EQ(cpu.gprValue(11), 2);
+    EXPECT_EQ(cpu.gprValue(31), 0x24);
+    EXPECT_EQ(cpu.gprValue(13), 5);
+    EXPECT_EQ(cpu.instructionCount(), 23u);
+
+    // an exception in a delay slot points EPC at the branch and sets BD
+    program->clear();
+    program->push_back(0x10000002); // beq $zero, $zero, skip
+    program->push_back(0x014a4820); // add $t1, $t2, $t2
+    program->push_back(0x00000000); // nop
+    program->push_back(0x00000000); // skip: nop
+
+    cpu.reset();
+    cpu.loadProgram(program);
+    cpu.setGPR(10, INT_MAX);
+    cpu.runProgram();
+
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_epc), 0u);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_cause), 0x80000030u);
+    EXPECT_EQ(cpu.pc(), 0x80000180u);
+}
+
 TEST(Complex, fibonacci)
 {
     boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
@@ -625,3 +883,1270 @@ TEST(Logical, op_nor)
     EXPECT_EQ(cpu.gprValue(7), 0x000f000f);
 }
 
+
+TEST(Memory, op_sw_lw)
+{
+    tememu::MipsCPU cpu;
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+    program->push_back(0x2004002a); // addi $a0, $zero, 42
+    program->push_back(0xac040040); // sw $a0, 64($zero)
+    program->push_back(0x8c050040); // lw $a1, 64($zero)
+    cpu.loadProgram(program);
+
+    cpu.runProgram();
+    EXPECT_EQ(cpu.gprValue(5), 42);
+    EXPECT_EQ(cpu.memory()->readWord(64), 42u);
+}
+
+TEST(Memory, op_sc_without_ll)
+{
+    tememu::MipsCPU cpu;
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+    program->push_back(0x2009002a); // addi $t1, $zero, 42
+    program->push_back(0xe0090100); // sc $t1, 0x100($zero)
+    cpu.loadProgram(program);
+
+    cpu.runProgram();
+    EXPECT_EQ(cpu.gprValue(9), 0);
+    EXPECT_EQ(cpu.memory()->readWord(0x100), 0u);
+}
+
+TEST(Smp, ll_sc_counter)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+    program->push_back(0x200803e8); // addi $t0, $zero, 1000
+    program->push_back(0x200b0001); // addi $t3, $zero, 1
+    program->push_back(0xc0090100); // retry: ll $t1, 0x100($zero)
+    program->push_back(0x21290001); // addi $t1, $t1, 1
+    program->push_back(0xe0090100); // sc $t1, 0x100($zero)
+    program->push_back(0x152bfffc); // bne $t1, $t3, retry
+    program->push_back(0x00000000); // nop
+    program->push_back(0x2108ffff); // addi $t0, $t0, -1
+    program->push_back(0x1500fff9); // bne $t0, $zero, retry
+    program->push_back(0x00000000); // nop
+
+    tememu::SmpSystem smp(4, 4096);
+    smp.loadProgram(program);
+    smp.run();
+
+    EXPECT_EQ(smp.memory()->readWord(0x100), 4000u);
+
+    for (int i = 0; i < smp.coreCount(); ++i)
+        EXPECT_EQ(smp.core(i).gprValue(8), 0);
+}
+
+TEST(Scheduler, many_contexts)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    loadMipsBinDump("testmips/fibo_2.bin", program);
+
+    std::vector<tememu::Scheduler::Context> contexts;
+
+    {
+        tememu::Scheduler scheduler(3, 7);
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            tememu::Scheduler::Context cpu(new tememu::MipsCPU);
+            cpu->loadProgram(program);
+            cpu->setGPR(7, i % 20 + 1);
+            contexts.push_back(cpu);
+            scheduler.spawn(cpu);
+        }
+
+        scheduler.waitIdle();
+        EXPECT_EQ(scheduler.contextCount(), 0u);
+    }
+
+    for (int i = 0; i < 1000; ++i)
+        EXPECT_EQ(fibo(i % 20 + 2), contexts[i]->gprValue(5));
+}
+
+namespace
+{
+    bool blockingHostCall(tememu::MipsCPU&) { return false; }
+}
+
+namespace
+{
+    bool throwingHostCall(tememu::MipsCPU&) { throw std::runtime_error("host call failed"); }
+}
+
+TEST(Scheduler, faulted_context)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    loadMipsBinDump("testmips/fibo_2.bin", program);
+
+    boost::shared_ptr< std::vector<int32> > faulting(new std::vector<int32>);
+    faulting->push_back(0x0000000c); // syscall
+
+    tememu::Scheduler scheduler(2, 7);
+    tememu::Scheduler::Context bad(new tememu::MipsCPU), good(new tememu::MipsCPU);
+    bad->loadProgram(faulting);
+    bad->setHostCallHandler(&throwingHostCall);
+    good->loadProgram(program);
+    good->setGPR(7, 10);
+
+    scheduler.spawn(bad);
+    scheduler.spawn(good);
+    scheduler.waitIdle();
+
+    // the other context ran to the end
+    EXPECT_EQ(fibo(11), good->gprValue(5));
+    EXPECT_EQ(scheduler.contextCount(), 0u);
+
+    tememu::Scheduler::Faults faults = scheduler.faults();
+    ASSERT_EQ(faults.size(), 1u);
+    EXPECT_EQ(faults.begin()->first, bad);
+    EXPECT_THROW(boost::rethrow_exception(faults.begin()->second), std::runtime_error);
+}
+
+TEST(Scheduler, block_on_host_call)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+    program->push_back(0x20020007); // addi $v0, $zero, 7
+    program->push_back(0x0000000c); // syscall
+    program->push_back(0x20430001); // addi $v1, $v0, 1
+
+    tememu::Scheduler scheduler(2, 100);
+    tememu::Scheduler::Context cpu(new tememu::MipsCPU);
+    cpu->loadProgram(program);
+    cpu->setHostCallHandler(&blockingHostCall);
+
+    scheduler.spawn(cpu);
+    scheduler.waitIdle();
+
+    EXPECT_TRUE(cpu->blocked());
+    EXPECT_EQ(scheduler.contextCount(), 1u);
+    EXPECT_EQ(cpu->gprValue(3), 0);
+
+    cpu->setGPR(2, 100); // result of the host call
+    scheduler.wake(cpu);
+    scheduler.waitIdle();
+
+    EXPECT_FALSE(cpu->blocked());
+    EXPECT_EQ(scheduler.contextCount(), 0u);
+    EXPECT_EQ(cpu->gprValue(3), 101);
+}
+
+namespace
+{
+    // wakes its own context from the first host call, which does not block
+    struct WakeThenBlock
+    {
+        tememu::Scheduler* scheduler;
+        tememu::Scheduler::Context* context;
+        int calls;
+
+        bool operator()(tememu::MipsCPU&)
+        {
+            if (calls++ > 0) return false;
+            scheduler->wake(*context);
+            return true;
+        }
+    };
+}
+
+TEST(Scheduler, wake_before_blocking)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+    program->push_back(0x0000000c); // syscall
+    program->push_back(0x20020007); // addi $v0, $zero, 7
+    program->push_back(0x0000000c); // syscall
+    program->push_back(0x20430001); // addi $v1, $v0, 1
+
+    tememu::Scheduler scheduler(1, 2);
+    tememu::Scheduler::Context cpu(new tememu::MipsCPU);
+    cpu->loadProgram(program);
+
+    WakeThenBlock handler = { &scheduler, &cpu, 0 };
+    cpu->setHostCallHandler(handler);
+
+    // neither running nor parked yet, so nothing to wake
+    scheduler.wake(cpu);
+    scheduler.spawn(cpu);
+    scheduler.waitIdle();
+
+    // the wake during the first quantum did not answer the second host call
+    EXPECT_TRUE(cpu->blocked());
+    EXPECT_EQ(scheduler.contextCount(), 1u);
+    EXPECT_EQ(cpu->gprValue(3), 0);
+
+    scheduler.wake(cpu);
+    scheduler.waitIdle();
+
+    EXPECT_EQ(scheduler.contextCount(), 0u);
+    EXPECT_EQ(cpu->gprValue(3), 8);
+}
+
+namespace
+{
+    void stopAfterAWhile(tememu::MipsCPU* cpu)
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+        cpu->requestStop();
+    }
+}
+
+TEST(Events, stop_from_other_thread)
+{
+    tememu::MipsCPU cpu;
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+    program->push_back(0x21080001); // loop: addi $t0, $t0, 1
+    program->push_back(0x08000000); // j loop
+    program->push_back(0x00000000); // nop
+    cpu.loadProgram(program);
+
+    boost::thread stopper(&stopAfterAWhile, &cpu);
+    cpu.runProgram();
+    stopper.join();
+
+    EXPECT_GT(cpu.gprValue(8), 0);
+    EXPECT_FALSE(cpu.halted());
+}
+
+TEST(Events, stop_before_step)
+{
+    tememu::MipsCPU cpu;
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+    program->push_back(0x2084000c); // addi $a0, $a0, 12
+    cpu.loadProgram(program);
+
+    cpu.requestStop();
+    EXPECT_EQ(cpu.stepProgram(), 0);
+    EXPECT_EQ(cpu.gprValue(4), 0);
+
+    // the stop request is consumed
+    EXPECT_EQ(cpu.stepProgram(), 1);
+    EXPECT_EQ(cpu.gprValue(4), 12);
+}
+
+TEST(Events, raise_interrupt)
+{
+    tememu::MipsCPU cpu;
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+    program->push_back(0x2084000c); // addi $a0, $a0, 12
+    program->push_back(0x2084000c); // addi $a0, $a0, 12
+    cpu.loadProgram(program);
+
+    cpu.raiseInterrupt(3);
+    EXPECT_EQ(cpu.pendingInterrupts(), 0u);
+
+    cpu.stepProgram();
+    EXPECT_EQ(cpu.pendingInterrupts(), 1u << 3);
+
+    cpu.clearInterrupt(3);
+    EXPECT_EQ(cpu.pendingInterrupts(), 0u);
+
+    // lines past the mask would land on the stop bit or outside the word
+    EXPECT_THROW(cpu.raiseInterrupt(31), std::out_of_range);
+    EXPECT_THROW(cpu.raiseInterrupt(32), std::out_of_range);
+    EXPECT_THROW(cpu.raiseInterrupt(-1), std::out_of_range);
+    EXPECT_THROW(cpu.clearInterrupt(8), std::out_of_range);
+    EXPECT_EQ(cpu.stepProgram(), 1);
+}
+
+namespace
+{
+    boost::shared_ptr< std::vector<int32> > racyCounterProgram()
+    {
+        boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+        program->push_back(0x200803e8); // addi $t0, $zero, 1000
+        program->push_back(0x8c090100); // loop: lw $t1, 0x100($zero)
+        program->push_back(0x21290001); // addi $t1, $t1, 1
+        program->push_back(0xac090100); // sw $t1, 0x100($zero)
+        program->push_back(0x2108ffff); // addi $t0, $t0, -1
+        program->push_back(0x1500fffb); // bne $t0, $zero, loop
+        program->push_back(0x00000000); // nop
+
+        return program;
+    }
+}
+
+TEST(Smp, deterministic_ll_sc_counter)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+    program->push_back(0x200803e8); // addi $t0, $zero, 1000
+    program->push_back(0x200b0001); // addi $t3, $zero, 1
+    program->push_back(0xc0090100); // retry: ll $t1, 0x100($zero)
+    program->push_back(0x21290001); // addi $t1, $t1, 1
+    program->push_back(0xe0090100); // sc $t1, 0x100($zero)
+    program->push_back(0x152bfffc); // bne $t1, $t3, retry
+    program->push_back(0x00000000); // nop
+    program->push_back(0x2108ffff); // addi $t0, $t0, -1
+    program->push_back(0x1500fff9); // bne $t0, $zero, retry
+    program->push_back(0x00000000); // nop
+
+    tememu::SmpSystem smp(4, 4096);
+    smp.loadProgram(program);
+    smp.runDeterministic(100);
+
+    EXPECT_EQ(smp.memory()->readWord(0x100), 4000u);
+}
+
+TEST(Smp, deterministic_instruction_count)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x20080001); // addi $t0, $zero, 1
+    program->push_back(0x0000000f); // sync
+
+    tememu::SmpSystem free(1, 4096), deterministic(1, 4096);
+    free.loadProgram(program);
+    free.run();
+    deterministic.loadProgram(program);
+    deterministic.runDeterministic(100);
+
+    // the sync completed at the barrier is counted once
+    EXPECT_EQ(free.core(0).instructionCount(), 2u);
+    EXPECT_EQ(deterministic.core(0).instructionCount(), 2u);
+    EXPECT_TRUE(deterministic.core(0).halted());
+}
+
+TEST(Smp, deterministic_is_reproducible)
+{
+    boost::uint32_t results[2];
+
+    for (int run = 0; run < 2; ++run)
+    {
+        tememu::SmpSystem smp(3, 4096);
+        smp.loadProgram(racyCounterProgram());
+        smp.runDeterministic(37);
+
+        results[run] = smp.memory()->readWord(0x100);
+
+        for (int i = 0; i < smp.coreCount(); ++i)
+            EXPECT_TRUE(smp.core(i).halted());
+    }
+
+    // the cores lose each other's increments, but always the same way
+    EXPECT_EQ(results[0], results[1]);
+    EXPECT_LT(results[0], 3000u);
+}
+
+TEST(Footprint, instance_size)
+{
+    // a million idle instances should stay well below 1 GB
+    EXPECT_LE(sizeof(tememu::MipsCPU), 512u);
+}
+
+TEST(Footprint, pool)
+{
+    tememu::CpuPool pool(64);
+    std::vector<tememu::MipsCPU*> cpus;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        cpus.push_back(pool.construct());
+        cpus.back()->setGPR(4, i);
+    }
+
+    EXPECT_EQ(pool.capacity(), 1024u);
+    EXPECT_EQ(cpus[999]->gprValue(4), 999);
+    EXPECT_EQ(cpus[0]->gprValue(5), 0);
+
+    for (int i = 0; i < 1000; ++i)
+        pool.destroy(cpus[i]);
+
+    // recycled storage, freshly constructed state
+    tememu::MipsCPU* cpu = pool.construct();
+    EXPECT_EQ(cpu->gprValue(4), 0);
+    EXPECT_EQ(pool.capacity(), 1024u);
+    pool.destroy(cpu);
+
+    boost::shared_ptr<tememu::MipsCPU> shared = pool.create();
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x2084000c); // addi $a0, $a0, 12
+    shared->loadProgram(program);
+    shared->runProgram();
+    EXPECT_EQ(shared->gprValue(4), 12);
+}
+
+TEST(Statistics, opcode_counts)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    tememu::MipsCPU cpu;
+
+    loadMipsBinDump("testmips/fibo_2.bin", program);
+    cpu.loadProgram(program);
+
+    EXPECT_FALSE(cpu.statisticsEnabled());
+    cpu.enableStatistics(true);
+
+    cpu.setGPR(7, 5);
+    cpu.runProgram();
+
+    int addi = tememu::MipsCPU::internalOpcode(0x20420001);
+    int bne = tememu::MipsCPU::internalOpcode(0x1427fff8);
+    int addu = tememu::MipsCPU::internalOpcode(0x00a43021);
+
+    EXPECT_STREQ(tememu::MipsCPU::opcodeName(addi), "op_addi");
+    EXPECT_STREQ(tememu::MipsCPU::opcodeName(bne), "op_bne");
+    EXPECT_STREQ(tememu::MipsCPU::opcodeName(addu), "op_addu");
+
+    EXPECT_EQ(cpu.retiredCount(addi), 1u + 5u);
+    EXPECT_EQ(cpu.retiredCount(bne), 5u);
+    EXPECT_EQ(cpu.retiredCount(addu), 5u);
+
+    cpu.resetStatistics();
+    EXPECT_EQ(cpu.retiredCount(addi), 0u);
+
+    cpu.enableStatistics(false);
+    EXPECT_FALSE(cpu.statisticsEnabled());
+    EXPECT_EQ(cpu.retiredCount(addi), 0u);
+
+    // an instruction that raises an exception does not retire
+    program->clear();
+    program->push_back(0x20080001); // addi $t0, $zero, 1
+    program->push_back(0x0000000d); // break
+
+    cpu.reset();
+    cpu.loadProgram(program);
+    cpu.enableStatistics(true);
+    cpu.runProgram();
+
+    int brk = tememu::MipsCPU::internalOpcode(0x0000000d);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_cause), boost::uint32_t(tememu::MipsCPU::exc_breakpoint << 2));
+    EXPECT_EQ(cpu.retiredCount(addi), 1u);
+    EXPECT_EQ(cpu.retiredCount(brk), 0u);
+}
+
+TEST(Disassembler, instructions)
+{
+    EXPECT_EQ(tememu::disassemble(0x00000000, 0), "nop");
+    EXPECT_EQ(tememu::disassemble(0x00a63824, 0), "and $a3, $a1, $a2");
+    EXPECT_EQ(tememu::disassemble(0x2108ffff, 0), "addi $t0, $t0, -1");
+    EXPECT_EQ(tememu::disassemble(0x1500fff9, 32), "bne $t0, $zero, 0x8");
+    EXPECT_EQ(tememu::disassemble(0x0800000c, 0), "j 0x30");
+    EXPECT_EQ(tememu::disassemble(0xc0090100, 0), "ll $t1, 256($zero)");
+    EXPECT_EQ(tememu::disassemble(0x71091002, 0), "mul $v0, $t0, $t1");
+    EXPECT_EQ(tememu::disassemble(0x71080000, 0), "madd $t0, $t0");
+    EXPECT_EQ(tememu::disassemble(0x00088f02, 0), "srl $s1, $t0, 28");
+    EXPECT_EQ(tememu::disassemble(0x2d23ffff, 0), "sltiu $v1, $t1, -1");
+    EXPECT_EQ(tememu::disassemble(0x46242180, 0), "add.d $f6, $f4, $f4");
+    EXPECT_EQ(tememu::disassemble(0x4601003c, 0), "c.lt.s $f0, $f1");
+    EXPECT_EQ(tememu::disassemble(0x401a6800, 0), "mfc0 $k0, $13");
+    EXPECT_EQ(tememu::disassemble(0xc4010404, 0), "lwc1 $f1, 1028($zero)");
+    EXPECT_EQ(tememu::disassemble(0xfc000000, 0), ".word 0xfc000000");
+
+    EXPECT_EQ(tememu::writtenRegister(0x00a63824), 7);
+    EXPECT_EQ(tememu::writtenRegister(0xac040040), tememu::no_register);
+}
+
+TEST(Trace, ring_buffer)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    boost::shared_ptr<tememu::TraceBuffer> trace(new tememu::TraceBuffer(3, true));
+    tememu::MipsCPU cpu;
+
+    program->push_back(0x2004000a); // addi $a0, $zero, 10
+    program->push_back(0x20840002); // addi $a0, $a0, 2
+    program->push_back(0xac040040); // sw $a0, 64($zero)
+    program->push_back(0x8c050040); // lw $a1, 64($zero)
+    program->push_back(0x20a50001); // addi $a1, $a1, 1
+    cpu.loadProgram(program);
+    cpu.attachTrace(trace);
+    cpu.runProgram();
+
+    // rounded up to a power of two, holds the last four instructions
+    EXPECT_EQ(trace->capacity(), 4u);
+    EXPECT_EQ(trace->written(), 5u);
+    ASSERT_EQ(trace->size(), 4u);
+
+    tememu::TraceRecord first = trace->record(0);
+    EXPECT_EQ(first.instr, 0x20840002u);
+    EXPECT_EQ(first.reg, 4);
+    EXPECT_EQ(first.value, 12u);
+
+    EXPECT_EQ(trace->record(1).reg, tememu::TraceBuffer::no_register);
+
+    tememu::TraceRecord last = trace->record(3);
+    EXPECT_EQ(last.pc, trace->record(2).pc + 4);
+    EXPECT_EQ(last.reg, 5);
+    EXPECT_EQ(last.value, 13u);
+}
+
+TEST(Trace, file_backed)
+{
+    const char* path = "trace_test.tmp";
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    tememu::MipsCPU cpu;
+
+    program->push_back(0x2004000a); // addi $a0, $zero, 10
+    program->push_back(0x20840002); // addi $a0, $a0, 2
+    cpu.loadProgram(program);
+
+    {
+        boost::shared_ptr<tememu::TraceBuffer> trace(new tememu::TraceBuffer(path, 16, false));
+        cpu.attachTrace(trace);
+        cpu.runProgram();
+        cpu.attachTrace(boost::shared_ptr<tememu::TraceBuffer>());
+    }
+
+    boost::shared_ptr<tememu::TraceBuffer> trace = tememu::TraceBuffer::open(path);
+
+    EXPECT_FALSE(trace->recordsRegisters());
+    ASSERT_EQ(trace->size(), 2u);
+    EXPECT_EQ(trace->record(1).instr, 0x20840002u);
+    EXPECT_EQ(trace->record(1).reg, tememu::TraceBuffer::no_register);
+
+    std::remove(path);
+}
+
+namespace
+{
+    boost::shared_ptr< std::vector<int32> > callingProgram()
+    {
+        boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+        program->push_back(0x20100003); // main: addi $s0, $zero, 3
+        program->push_back(0x2210ffff); // loop: addi $s0, $s0, -1
+        program->push_back(0x0c000008); // jal f
+        program->push_back(0x00000000); // nop
+        program->push_back(0x1600fffc); // bne $s0, $zero, loop
+        program->push_back(0x00000000); // nop
+        program->push_back(0x08000011); // j end
+        program->push_back(0x00000000); // nop
+        program->push_back(0x03e0c820); // f: add $t9, $ra, $zero
+        program->push_back(0x0c00000e); // jal g
+        program->push_back(0x00000000); // nop
+        program->push_back(0x0320f820); // add $ra, $t9, $zero
+        program->push_back(0x03e00008); // jr $ra
+        program->push_back(0x00000000); // nop
+        program->push_back(0x21080001); // g: addi $t0, $t0, 1
+        program->push_back(0x03e00008); // jr $ra
+        program->push_back(0x00000000); // nop
+                                        // end:
+        return program;
+    }
+}
+
+TEST(Profiler, folded_stacks)
+{
+    tememu::MipsCPU cpu;
+    boost::shared_ptr<tememu::Profiler> profiler(new tememu::Profiler(1));
+    tememu::SymbolTable symbols;
+
+    std::istringstream nm("00000000 T main\n00000020 T f\n00000038 T g\n");
+    symbols.load(nm);
+    EXPECT_EQ(symbols.lookup(0x3c), "g");
+    EXPECT_EQ(symbols.nameOrAddress(0x24), "f");
+
+    cpu.loadProgram(callingProgram());
+    cpu.enableStatistics(true);
+    cpu.attachProfiler(profiler);
+    cpu.runProgram();
+
+    EXPECT_EQ(cpu.gprValue(8), 3);
+    EXPECT_EQ(profiler->depth(), 0u);
+
+    boost::uint64_t retired = 0;
+    for (int i = 0; i < tememu::internal_opcode_count; ++i) retired += cpu.retiredCount(i);
+    EXPECT_EQ(profiler->sampleCount(), retired);
+
+    std::ostringstream folded;
+    profiler->writeFolded(folded, symbols);
+
+    std::string text = folded.str();
+    EXPECT_NE(text.find("main "), std::string::npos);
+    EXPECT_NE(text.find("main;f "), std::string::npos);
+    EXPECT_NE(text.find("main;f;g "), std::string::npos);
+
+    std::ostringstream pprof;
+    profiler->writePprof(pprof);
+
+    std::string data = pprof.str();
+    const uintptr_t* words = reinterpret_cast<const uintptr_t*>(data.data());
+    EXPECT_EQ(words[0], 0u);
+    EXPECT_EQ(words[1], 3u);
+    EXPECT_EQ(words[3], 1u);
+
+    // no period of whole microseconds for these
+    EXPECT_THROW(profiler->startTimer(0), std::invalid_argument);
+    EXPECT_THROW(profiler->startTimer(1000001), std::invalid_argument);
+}
+
+namespace
+{
+    struct HookRecorder
+    {
+        HookRecorder() : retired(0) {}
+
+        void onRetired(boost::uint32_t, boost::int32_t) { ++retired; }
+        void onBranch(boost::uint32_t pc, boost::uint32_t target) { branches.push_back(pc); branches.push_back(target); }
+        void onRead(boost::uint32_t addr, boost::uint32_t value) { reads.push_back(addr); reads.push_back(value); }
+        void onWrite(boost::uint32_t addr, boost::uint32_t value) { writes.push_back(addr); writes.push_back(value); }
+        void onBlock(boost::uint32_t pc) { blocks.push_back(pc); }
+
+        int retired;
+        std::vector<boost::uint32_t> branches, reads, writes, blocks;
+    };
+}
+
+TEST(Hooks, callbacks)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    tememu::MipsCPU cpu;
+    HookRecorder recorder;
+    tememu::Hooks hooks;
+
+    program->push_back(0x20080100); // addi $t0, $zero, 0x100
+    program->push_back(0x20090003); // addi $t1, $zero, 3
+    program->push_back(0xad090000); // loop: sw $t1, 0($t0)
+    program->push_back(0x8d0a0000); // lw $t2, 0($t0)
+    program->push_back(0x2129ffff); // addi $t1, $t1, -1
+    program->push_back(0x1520fffc); // bne $t1, $zero, loop
+    program->push_back(0x00000000); // nop
+    cpu.loadProgram(program);
+
+    hooks.instructionRetired = fastdelegate::MakeDelegate(&recorder, &HookRecorder::onRetired);
+    hooks.branchTaken = fastdelegate::MakeDelegate(&recorder, &HookRecorder::onBranch);
+    hooks.memoryRead = fastdelegate::MakeDelegate(&recorder, &HookRecorder::onRead);
+    hooks.memoryWrite = fastdelegate::MakeDelegate(&recorder, &HookRecorder::onWrite);
+    hooks.blockEntry = fastdelegate::MakeDelegate(&recorder, &HookRecorder::onBlock);
+    cpu.setHooks(hooks);
+
+    int executed = cpu.stepProgram(100);
+
+    EXPECT_TRUE(cpu.halted());
+    EXPECT_EQ(recorder.retired, executed);
+
+    ASSERT_EQ(recorder.branches.size(), 4u);
+    EXPECT_EQ(recorder.branches[0], 0x14u);
+    EXPECT_EQ(recorder.branches[1], 0x08u);
+
+    ASSERT_EQ(recorder.blocks.size(), 3u);
+    EXPECT_EQ(recorder.blocks[0], 0x00u);
+    EXPECT_EQ(recorder.blocks[1], 0x08u);
+    EXPECT_EQ(recorder.blocks[2], 0x08u);
+
+    ASSERT_EQ(recorder.writes.size(), 6u);
+    ASSERT_EQ(recorder.reads.size(), 6u);
+    EXPECT_EQ(recorder.writes[0], 0x100u);
+    EXPECT_EQ(recorder.writes[1], 3u);
+    EXPECT_EQ(recorder.reads[4], 0x100u);
+    EXPECT_EQ(recorder.reads[5], 1u);
+
+    // removing every hook goes back to the plain run loop
+    cpu.setHooks(tememu::Hooks());
+    cpu.reset();
+    cpu.runProgram();
+    EXPECT_EQ(recorder.retired, executed);
+}
+
+TEST(Coverage, edges_and_merge)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    boost::shared_ptr<tememu::CoverageMap> coverage(new tememu::CoverageMap);
+    tememu::MipsCPU cpu;
+
+    program->push_back(0x20090003); // addi $t1, $zero, 3
+    program->push_back(0x2129ffff); // loop: addi $t1, $t1, -1
+    program->push_back(0x1520fffe); // bne $t1, $zero, loop
+    program->push_back(0x00000000); // nop
+    cpu.loadProgram(program);
+    cpu.attachCoverage(coverage);
+    cpu.runProgram();
+
+    // entry -> 0x0, 0x0 -> loop, loop -> loop (twice)
+    EXPECT_EQ(coverage->edgeCount(), 3u);
+
+    tememu::CoverageMap total;
+    EXPECT_EQ(total.merge(*coverage), 3u);
+    EXPECT_EQ(total.merge(*coverage), 0u);
+    EXPECT_EQ(total.edgeCount(), 3u);
+
+    // hit counts add up and saturate
+    tememu::CoverageMap run;
+    total.data()[7] = 200;
+    run.data()[7] = 100;
+    run.data()[9] = 1;
+    EXPECT_EQ(total.merge(run), 1u);
+    EXPECT_EQ(total.data()[7], 255);
+    EXPECT_EQ(total.data()[9], 1);
+}
+
+TEST(Coverage, file_backed)
+{
+    const char* path = "coverage_test.tmp";
+
+    {
+        tememu::CoverageMap writer(path);
+        tememu::CoverageMap reader(path);
+
+        writer.clear();
+        writer.edge(0x100, 0x200);
+        EXPECT_EQ(reader.edgeCount(), 1u);
+    }
+
+    std::remove(path);
+}
+
+namespace
+{
+    boost::shared_ptr< std::vector<int32> > hostCallProgram()
+    {
+        boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+        program->push_back(0x20110005); // addi $s1, $zero, 5
+        program->push_back(0x0000000c); // loop: syscall
+        program->push_back(0x02028021); // addu $s0, $s0, $v0
+        program->push_back(0x8c080200); // lw $t0, 0x200($zero)
+        program->push_back(0x02088021); // addu $s0, $s0, $t0
+        program->push_back(0x2231ffff); // addi $s1, $s1, -1
+        program->push_back(0x1620fffa); // bne $s1, $zero, loop
+        program->push_back(0x00000000); // nop
+        return program;
+    }
+
+    bool ignoreHostCall(tememu::MipsCPU&)
+    {
+        return true;
+    }
+
+    // stands for a host whose answers differ from run to run
+    struct ChangingHost
+    {
+        int calls;
+
+        bool operator()(tememu::MipsCPU& cpu)
+        {
+            ++calls;
+            cpu.setGPR(2, calls * 7);
+            cpu.writeGuestWord(0x200, calls * 100);
+            return true;
+        }
+    };
+}
+
+TEST(Replay, snapshot_roundtrip)
+{
+    tememu::MipsCPU cpu;
+    tememu::Snapshot saved, loaded;
+
+    cpu.loadProgram(hostCallProgram());
+    cpu.setHostCallHandler(&ignoreHostCall);
+    cpu.stepProgram(3);
+    cpu.saveSnapshot(saved);
+
+    std::stringstream stream;
+    saved.write(stream);
+    loaded.read(stream);
+
+    tememu::MipsCPU copy;
+    copy.setHostCallHandler(&ignoreHostCall);
+    copy.restoreSnapshot(loaded);
+
+    EXPECT_EQ(copy.instructionCount(), 3u);
+    EXPECT_EQ(copy.gprValue(17), 5);
+    EXPECT_EQ(copy.memory()->size(), cpu.memory()->size());
+    EXPECT_EQ(copy.memory()->readWord(4), 0x0000000cu);
+
+    cpu.runProgram();
+    copy.runProgram();
+    EXPECT_EQ(copy.gprValue(16), cpu.gprValue(16));
+}
+
+TEST(Replay, record_and_replay)
+{
+    const char* path = "replay_test.tmp";
+    tememu::MipsCPU recorded, replayed;
+    tememu::Snapshot start;
+    ChangingHost host = { 0 };
+
+    recorded.loadProgram(hostCallProgram());
+    recorded.setHostCallHandler(boost::ref(host));
+    recorded.saveSnapshot(start);
+
+    {
+        boost::shared_ptr<tememu::Recorder> recorder(new tememu::Recorder(path));
+        recorded.attachRecorder(recorder);
+        recorded.stepProgram(10);
+        recorded.raiseInterrupt(3);
+        recorded.runProgram();
+        recorded.attachRecorder(boost::shared_ptr<tememu::Recorder>());
+    }
+
+    boost::shared_ptr<tememu::Replayer> replayer(new tememu::Replayer(path));
+    replayed.restoreSnapshot(start);
+    replayed.attachReplayer(replayer);
+
+    // the interrupt arrives at the same instruction
+    replayed.stepProgram(10);
+    EXPECT_EQ(replayed.pendingInterrupts(), 0u);
+    replayed.stepProgram(1);
+    EXPECT_EQ(replayed.pendingInterrupts(), 1u << 3);
+
+    replayed.runProgram();
+
+    EXPECT_EQ(host.calls, 5);
+    EXPECT_TRUE(replayer->finished());
+    EXPECT_EQ(replayed.gprValue(16), recorded.gprValue(16));
+    EXPECT_EQ(replayed.memory()->readWord(0x200), 500u);
+    EXPECT_EQ(replayed.instructionCount(), recorded.instructionCount());
+
+    std::remove(path);
+}
+
+namespace
+{
+    boost::shared_ptr< std::vector<int32> > longHostCallProgram()
+    {
+        boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+
+        program->push_back(0x201100c8); // addi $s1, $zero, 200
+        program->push_back(0x0000000c); // loop: syscall
+        program->push_back(0x02028021); // addu $s0, $s0, $v0
+        program->push_back(0xac100400); // sw $s0, 0x400($zero)
+        program->push_back(0x2231ffff); // addi $s1, $s1, -1
+        program->push_back(0x1620fffb); // bne $s1, $zero, loop
+        program->push_back(0x00000000); // nop
+        return program;
+    }
+
+    bool atSyscall(const tememu::MipsCPU& cpu)
+    {
+        return cpu.pc() == 4;
+    }
+}
+
+TEST(Reverse, step_seek_and_continue)
+{
+    // the same run without the debugger, for the expected states
+    tememu::MipsCPU reference;
+    ChangingHost referenceHost = { 0 };
+    std::vector<int32> s0;
+
+    reference.loadProgram(longHostCallProgram());
+    reference.setHostCallHandler(boost::ref(referenceHost));
+    while (!reference.halted())
+    {
+        s0.push_back(reference.gprValue(16));
+        reference.stepProgram(1);
+    }
+
+    tememu::MipsCPU cpu;
+    ChangingHost host = { 0 };
+    cpu.loadProgram(longHostCallProgram());
+    cpu.setHostCallHandler(boost::ref(host));
+
+    tememu::ReverseDebugger debugger(cpu, 32 * 1024, 50);
+    EXPECT_EQ(debugger.run(1000), 1000);
+    int calls = host.calls;
+
+    // going back does not ask the host again
+    EXPECT_TRUE(debugger.reverseStep());
+    EXPECT_EQ(cpu.instructionCount(), 999u);
+    EXPECT_EQ(cpu.gprValue(16), s0[999]);
+
+    EXPECT_TRUE(debugger.seek(500));
+    EXPECT_EQ(cpu.gprValue(16), s0[500]);
+    EXPECT_EQ(cpu.memory()->readWord(0x400), boost::uint32_t(s0[500]));
+
+    EXPECT_TRUE(debugger.reverseContinue(&atSyscall));
+    EXPECT_LT(cpu.instructionCount(), 500u);
+    EXPECT_GT(cpu.instructionCount(), 490u);
+    EXPECT_EQ(cpu.pc(), 4u);
+    EXPECT_EQ(cpu.gprValue(16), s0[cpu.instructionCount()]);
+    EXPECT_EQ(host.calls, calls);
+
+    // the checkpoints stay in budget by spreading out
+    EXPECT_GT(debugger.interval(), 50u);
+    EXPECT_LE(debugger.memoryUsed(), 32u * 1024);
+
+    // forward past the recorded history talks to the host again
+    while (!cpu.halted()) debugger.run(1000);
+    EXPECT_EQ(cpu.gprValue(16), reference.gprValue(16));
+    EXPECT_EQ(host.calls, 200);
+
+    EXPECT_TRUE(debugger.seek(0));
+    EXPECT_FALSE(debugger.reverseStep());
+    EXPECT_EQ(cpu.instructionCount(), 0u);
+    EXPECT_EQ(cpu.memory()->readWord(0x400), 0u);
+}
+
+TEST(Reverse, syscall_without_handler)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x20100001); // addi $s0, $zero, 1
+    program->push_back(0x0000000c); // syscall
+    program->push_back(0x22100001); // addi $s0, $s0, 1
+    program->push_back(0x08000400); // j 0x1000
+    program->push_back(0x00000000); // nop
+    program->resize(0x180 / 4, 0);  // nop up to the exception vector
+
+    // counts the exception and returns past the syscall
+    program->push_back(0x22310001); // addi $s1, $s1, 1
+    program->push_back(0x401a7000); // mfc0 $k0, $14
+    program->push_back(0x235a0004); // addi $k0, $k0, 4
+    program->push_back(0x409a7000); // mtc0 $k0, $14
+    program->push_back(0x42000018); // eret
+
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    cpu.setExceptionBase(0);
+
+    tememu::ReverseDebugger debugger(cpu, 32 * 1024, 2);
+    while (!cpu.halted()) debugger.run(100);
+    boost::uint64_t end = cpu.instructionCount();
+    EXPECT_EQ(cpu.gprValue(16), 2);
+    EXPECT_EQ(cpu.gprValue(17), 1);
+
+    // replaying over the syscall raises the exception again
+    EXPECT_TRUE(debugger.seek(1));
+    EXPECT_EQ(cpu.pc(), 4u);
+    EXPECT_EQ(cpu.gprValue(17), 0);
+
+    EXPECT_TRUE(debugger.seek(end));
+    EXPECT_TRUE(debugger.reverseStep());
+    EXPECT_TRUE(debugger.seek(end));
+    EXPECT_EQ(cpu.gprValue(16), 2);
+    EXPECT_EQ(cpu.gprValue(17), 1);
+    EXPECT_TRUE(cpu.halted());
+}
+
+TEST(Debugger, breakpoints_and_watchpoints)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x20080005); // addi $t0, $zero, 5
+    program->push_back(0x21290001); // loop: addi $t1, $t1, 1
+    program->push_back(0xac090400); // sw $t1, 0x400($zero)
+    program->push_back(0x2108ffff); // addi $t0, $t0, -1
+    program->push_back(0x1500fffc); // bne $t0, $zero, loop
+    program->push_back(0x00000000); // nop
+
+    tememu::MipsCPU cpu;
+    cpu.addBreakpoint(12);
+    cpu.loadProgram(program);
+    EXPECT_TRUE(cpu.hasBreakpoint(12));
+
+    tememu::Snapshot start;
+    cpu.saveSnapshot(start);
+
+    // stops before the instruction, and resuming does not hit it again
+    cpu.runProgram();
+    EXPECT_EQ(cpu.debugStop(), tememu::MipsCPU::debug_breakpoint);
+    EXPECT_EQ(cpu.pc(), 12u);
+    EXPECT_EQ(cpu.gprValue(9), 1);
+    EXPECT_EQ(cpu.gprValue(8), 5);
+
+    cpu.runProgram();
+    EXPECT_EQ(cpu.pc(), 12u);
+    EXPECT_EQ(cpu.gprValue(9), 2);
+
+    // stops after the write
+    cpu.removeBreakpoint(12);
+    EXPECT_FALSE(cpu.hasBreakpoint(12));
+    cpu.addWatchpoint(0x400, 4);
+    cpu.runProgram();
+    EXPECT_EQ(cpu.debugStop(), tememu::MipsCPU::debug_watchpoint);
+    EXPECT_EQ(cpu.watchAddress(), 0x400u);
+    EXPECT_EQ(cpu.pc(), 12u);
+    EXPECT_EQ(cpu.memory()->readWord(0x400), 3u);
+
+    cpu.removeWatchpoint(0x400, 4);
+    cpu.runProgram();
+    EXPECT_EQ(cpu.debugStop(), tememu::MipsCPU::debug_none);
+    EXPECT_TRUE(cpu.halted());
+    EXPECT_EQ(cpu.gprValue(9), 5);
+
+    // a restore that allocates the memory arms both of them on it
+    tememu::MipsCPU restored;
+    restored.addBreakpoint(4);
+    restored.addWatchpoint(0x400, 4);
+    restored.restoreSnapshot(start);
+
+    restored.runProgram();
+    EXPECT_EQ(restored.debugStop(), tememu::MipsCPU::debug_breakpoint);
+    EXPECT_EQ(restored.pc(), 4u);
+
+    restored.removeBreakpoint(4);
+    restored.runProgram();
+    EXPECT_EQ(restored.debugStop(), tememu::MipsCPU::debug_watchpoint);
+    EXPECT_EQ(restored.memory()->readWord(0x400), 1u);
+}
+
+TEST(Debugger, watchpoint_across_cores)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x10800008); // beq $a0, $zero, writer
+    program->push_back(0x00000000); // nop
+    program->push_back(0x20090001); // addi $t1, $zero, 1
+    program->push_back(0xac090800); // sw $t1, 0x800($zero)
+    program->push_back(0x2108ffff); // loop: addi $t0, $t0, -1
+    program->push_back(0x1500fffe); // bne $t0, $zero, loop
+    program->push_back(0x00000000); // nop
+    program->push_back(0x0800000e); // j end
+    program->push_back(0x00000000); // nop
+    program->push_back(0x8c090800); // writer: lw $t1, 0x800($zero)
+    program->push_back(0x1120fffe); // beq $t1, $zero, writer
+    program->push_back(0x00000000); // nop
+    program->push_back(0x20090007); // addi $t1, $zero, 7
+    program->push_back(0xac090400); // sw $t1, 0x400($zero)
+
+    tememu::SmpSystem smp(2, 4096);
+    smp.loadProgram(program);
+
+    // core 1 tells core 0 it runs, then spins until core 0 writes the watched word
+    smp.core(1).setGPR(4, 1);
+    smp.core(1).setGPR(8, 50000000);
+    smp.core(1).addWatchpoint(0x400, 4);
+
+    // a watchpoint of another core neither replaces nor removes core 1's
+    smp.core(0).addWatchpoint(0x800, 4);
+    smp.core(0).removeWatchpoint(0x800, 4);
+
+    smp.run();
+
+    EXPECT_EQ(smp.core(1).debugStop(), tememu::MipsCPU::debug_watchpoint);
+    EXPECT_EQ(smp.core(1).watchAddress(), 0x400u);
+    EXPECT_FALSE(smp.core(1).halted());
+    EXPECT_NE(smp.core(1).gprValue(8), 0);
+
+    EXPECT_TRUE(smp.core(0).halted());
+    EXPECT_EQ(smp.core(0).debugStop(), tememu::MipsCPU::debug_none);
+    EXPECT_EQ(smp.memory()->readWord(0x400), 7u);
+}
+
+namespace
+{
+    // sends a packet like gdb does and returns the reply
+    std::string gdbCommand(boost::asio::ip::tcp::socket& socket, const std::string& packet)
+    {
+        unsigned char sum = 0;
+        for (size_t i = 0; i < packet.size(); ++i) sum += packet[i];
+        char checksum[3];
+        std::sprintf(checksum, "%02x", sum);
+        boost::asio::write(socket, boost::asio::buffer("$" + packet + "#" + checksum));
+
+        boost::asio::streambuf input;
+        boost::asio::read_until(socket, input, '#');
+        std::string reply((std::istreambuf_iterator<char>(&input)), std::istreambuf_iterator<char>());
+        reply = reply.substr(reply.find('$') + 1);
+        reply = reply.substr(0, reply.find('#'));
+        boost::asio::write(socket, boost::asio::buffer("+", 1));
+        return reply;
+    }
+
+    void serveGdb(tememu::GdbStub* stub)
+    {
+        stub->serve();
+    }
+}
+
+TEST(GdbStub, session)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x20080005); // addi $t0, $zero, 5
+    program->push_back(0x21290001); // loop: addi $t1, $t1, 1
+    program->push_back(0xac090400); // sw $t1, 0x400($zero)
+    program->push_back(0x2108ffff); // addi $t0, $t0, -1
+    program->push_back(0x1500fffc); // bne $t0, $zero, loop
+    program->push_back(0x00000000); // nop
+
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+
+    tememu::GdbStub stub(cpu);
+    unsigned short port = stub.listenTcp(0);
+    boost::thread server(&serveGdb, &stub);
+
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::socket socket(io);
+    socket.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+
+    EXPECT_EQ(gdbCommand(socket, "?"), "T05");
+    EXPECT_EQ(gdbCommand(socket, "p25"), "00000000"); // pc
+
+    EXPECT_EQ(gdbCommand(socket, "Z0,c,4"), "OK");
+    EXPECT_EQ(gdbCommand(socket, "c"), "T05");
+    EXPECT_EQ(gdbCommand(socket, "p25"), "0000000c");
+    EXPECT_EQ(gdbCommand(socket, "p9"), "00000001");
+    EXPECT_EQ(gdbCommand(socket, "g").substr(9 * 8, 8), "00000001");
+
+    EXPECT_EQ(gdbCommand(socket, "z0,c,4"), "OK");
+    EXPECT_EQ(gdbCommand(socket, "Z2,400,4"), "OK");
+    EXPECT_EQ(gdbCommand(socket, "c"), "T05watch:00000400;");
+    EXPECT_EQ(gdbCommand(socket, "m400,4"), "00000002");
+
+    // memory and registers are big-endian
+    EXPECT_EQ(gdbCommand(socket, "M400,4:12345678"), "OK");
+    EXPECT_EQ(gdbCommand(socket, "m402,2"), "5678");
+    EXPECT_EQ(gdbCommand(socket, "P9=00000010"), "OK");
+    EXPECT_EQ(gdbCommand(socket, "s"), "T05");
+    EXPECT_EQ(gdbCommand(socket, "p25"), "00000010");
+    EXPECT_EQ(cpu.gprValue(9), 0x10);
+
+    EXPECT_EQ(gdbCommand(socket, "z2,400,4"), "OK");
+    EXPECT_EQ(gdbCommand(socket, "c"), "W00");
+    EXPECT_EQ(gdbCommand(socket, "D"), "OK");
+    server.join();
+
+    EXPECT_EQ(cpu.gprValue(9), 0x13);
+}
+
+TEST(Exceptions, precise_delivery)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x014a4820); // add $t1, $t2, $t2
+    program->push_back(0x8c0b0002); // lw $t3, 2($zero)
+    program->push_back(0x0000000d); // break
+    program->push_back(0x0000000c); // syscall
+    program->push_back(0x408c6000); // mtc0 $t4, $12
+    program->push_back(0x200d0007); // addi $t5, $zero, 7
+    program->push_back(0x20110001); // addi $s1, $zero, 1
+    program->push_back(0x08000400); // j 0x1000
+    program->resize(0x180 / 4, 0);  // nop up to the exception vector
+
+    // records ExcCode and EPC, then returns past the faulting instruction 
+    // or, for the interrupt, masks interrupts and returns to EPC
+    program->push_back(0x401a6800); // mfc0 $k0, $13
+    program->push_back(0x001ad082); // srl $k0, $k0, 2
+    program->push_back(0x335a001f); // andi $k0, $k0, 0x1f
+    program->push_back(0xae1a0400); // sw $k0, 0x400($s0)
+    program->push_back(0x401b7000); // mfc0 $k1, $14
+    program->push_back(0xae1b0440); // sw $k1, 0x440($s0)
+    program->push_back(0x22100004); // addi $s0, $s0, 4
+    program->push_back(0x13400004); // beq $k0, $zero, irq
+    program->push_back(0x00000000); // nop
+    program->push_back(0x237b0004); // addi $k1, $k1, 4
+    program->push_back(0x409b7000); // mtc0 $k1, $14
+    program->push_back(0x42000018); // eret
+    program->push_back(0x40806000); // irq: mtc0 $zero, $12
+    program->push_back(0x42000018); // eret
+
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    cpu.setExceptionBase(0); // the handler is in the text
+    cpu.setGPR(10, INT_MAX);
+    cpu.setGPR(12, 0x401); // Status: IE and IM2
+    cpu.raiseInterrupt(2);
+    cpu.runProgram();
+
+    const boost::uint32_t codes[] = { 12, 4, 9, 8, 0 };
+    const boost::uint32_t epcs[] = { 0, 4, 8, 12, 20 };
+    for (int i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(cpu.memory()->readWord(0x400 + i * 4), codes[i]);
+        EXPECT_EQ(cpu.memory()->readWord(0x440 + i * 4), epcs[i]);
+    }
+
+    // the overflowing add left its destination alone
+    EXPECT_EQ(cpu.gprValue(9), 0);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_badvaddr), 2u);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_status), 0u);
+    EXPECT_EQ(cpu.gprValue(13), 7);
+    EXPECT_EQ(cpu.gprValue(17), 1);
+    EXPECT_TRUE(cpu.halted());
+}
+
+TEST(Exceptions, address_out_of_range)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x8c08fffc); // lw $t0, -4($zero)
+
+    // no host exception; the default vector is outside the program, so the CPU halts there
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    EXPECT_NO_THROW(cpu.runProgram());
+    EXPECT_EQ(cpu.pc(), 0x80000180u);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_cause), boost::uint32_t(tememu::MipsCPU::exc_address_load << 2));
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_badvaddr), 0xfffffffcu);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_epc), 0u);
+
+    (*program)[0] = 0xac08fff8;     // sw $t0, -8($zero)
+    cpu.reset();
+    cpu.loadProgram(program);
+    EXPECT_NO_THROW(cpu.runProgram());
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_cause), boost::uint32_t(tememu::MipsCPU::exc_address_store << 2));
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_badvaddr), 0xfffffff8u);
+}
+
+TEST(Exceptions, unaligned_jump_target)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x20080022); // addi $t0, $zero, 0x22
+    program->push_back(0x01000008); // jr $t0
+    program->push_back(0x20090005); // addi $t1, $zero, 5
+
+    // the delay slot runs, then the fetch from the target faults
+    tememu::MipsCPU cpu;
+    cpu.loadProgram(program);
+    cpu.runProgram();
+
+    EXPECT_EQ(cpu.gprValue(9), 5);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_cause), boost::uint32_t(tememu::MipsCPU::exc_address_load << 2));
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_epc), 0x22u);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_badvaddr), 0x22u);
+    EXPECT_EQ(cpu.pc(), 0x80000180u);
+    EXPECT_EQ(cpu.instructionCount(), 3u);
+
+    // jalr links before the fault, stepping included
+    (*program)[1] = 0x0100f809;     // jalr $t0
+    cpu.reset();
+    cpu.loadProgram(program);
+    while (!cpu.halted()) cpu.stepProgram();
+
+    EXPECT_EQ(cpu.gprValue(31), 0xc);
+    EXPECT_EQ(cpu.gprValue(9), 5);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_epc), 0x22u);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_badvaddr), 0x22u);
+    EXPECT_EQ(cpu.pc(), 0x80000180u);
+
+    // and so does eret to an unaligned EPC
+    program->assign(1, 0x42000018); // eret
+    cpu.reset();
+    cpu.loadProgram(program);
+    cpu.setCop0(tememu::MipsCPU::cop0_epc, 0x26);
+    cpu.runProgram();
+
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_epc), 0x26u);
+    EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_badvaddr), 0x26u);
+    EXPECT_EQ(cpu.pc(), 0x80000180u);
+}
+
+TEST(Exceptions, timer_interrupt)
+{
+    boost::shared_ptr< std::vector<int32> > program(new std::vector<int32>);
+    program->push_back(0x20080029); // addi $t0, $zero, 41
+    program->push_back(0x40885800); // mtc0 $t0, $11
+    program->push_back(0x34098001); // ori $t1, $zero, 0x8001
+    program->push_back(0x40896000); // mtc0 $t1, $12
+    program->push_back(0x40114800); // mfc0 $s1, $9
+    program->push_back(0x22100001); // loop: addi $s0, $s0, 1
+    program->push_back(0x08000005); // j loop
+    program->push_back(0x00000000); // nop
+    program->resize(0x180 / 4, 0);  // nop up to the exception vector
+
+    // reads Count and Cause, acknowledges the interrupt and falls off the end
+    program->push_back(0x40124800); // mfc0 $s2, $9
+    program->push_back(0x40136800); // mfc0 $s3, $13
+    program->push_back(0x40885800); // mtc0 $t0, $11
+    program->push_back(0x40146800); // mfc0 $s4, $13
+
+    // the interrupt comes at the same count however the run is sliced
+    for (int steps = 0; steps < 2; ++steps)
+    {
+        tememu::MipsCPU cpu;
+        cpu.loadProgram(program);
+        cpu.setExceptionBase(0);
+        if (steps) while (!cpu.halted()) cpu.stepProgram();
+        else cpu.runProgram();
+
+        EXPECT_EQ(cpu.gprValue(17), 4);
+        EXPECT_EQ(cpu.gprValue(18), 41);
+        EXPECT_EQ(cpu.gprValue(19), 0x8000);
+        EXPECT_EQ(cpu.gprValue(20), 0);
+        EXPECT_EQ(cpu.cop0(tememu::MipsCPU::cop0_count), 45u);
+        EXPECT_EQ(cpu.instructionCount(), 45u);
+    }
+}
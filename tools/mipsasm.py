@@ -0,0 +1,192 @@
+#!/usr/bin/env python
+# The MIT License
+#
+# Copyright (c) 2011, Tamás Szelei
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+"""Minimal MIPS32 assembler for the benchmark corpus in ./benchmips.
+
+Usage:
+    tools/mipsasm.py source.s            print one word per line
+    tools/mipsasm.py source.s output.bin write a little endian binary
+
+Supports labels, '#' comments, the R/I/J instructions the emulator
+implements and '.word' (a number or a label). Branch offsets are counted
+from the delay slot, like a real assembler would.
+"""
+
+import re
+import struct
+import sys
+
+REGISTERS = {
+    'zero': 0, 'at': 1, 'v0': 2, 'v1': 3, 'a0': 4, 'a1': 5, 'a2': 6, 'a3': 7,
+    't0': 8, 't1': 9, 't2': 10, 't3': 11, 't4': 12, 't5': 13, 't6': 14, 't7': 15,
+    's0': 16, 's1': 17, 's2': 18, 's3': 19, 's4': 20, 's5': 21, 's6': 22, 's7': 23,
+    't8': 24, 't9': 25, 'k0': 26, 'k1': 27, 'gp': 28, 'sp': 29, 'fp': 30, 'ra': 31,
+}
+
+# function field of the SPECIAL (opcode 0) instructions
+FUNCT = {
+    'sll': 0x00, 'srl': 0x02, 'sra': 0x03, 'sllv': 0x04, 'srlv': 0x06, 'srav': 0x07,
+    'jr': 0x08, 'jalr': 0x09, 'syscall': 0x0C, 'break': 0x0D, 'sync': 0x0F,
+    'mfhi': 0x10, 'mthi': 0x11, 'mflo': 0x12, 'mtlo': 0x13,
+    'mult': 0x18, 'multu': 0x19, 'div': 0x1A, 'divu': 0x1B,
+    'add': 0x20, 'addu': 0x21, 'sub': 0x22, 'subu': 0x23,
+    'and': 0x24, 'or': 0x25, 'xor': 0x26, 'nor': 0x27, 'slt': 0x2A, 'sltu': 0x2B,
+}
+
+# function field of the SPECIAL2 (opcode 0x1C) instructions
+FUNCT2 = {'madd': 0x00, 'maddu': 0x01, 'mul': 0x02, 'msub': 0x04, 'msubu': 0x05}
+
+OPCODE = {
+    'j': 0x02, 'jal': 0x03, 'beq': 0x04, 'bne': 0x05,
+    'addi': 0x08, 'addiu': 0x09, 'slti': 0x0A, 'sltiu': 0x0B,
+    'andi': 0x0C, 'ori': 0x0D,
+    'lw': 0x23, 'sw': 0x2B, 'll': 0x30, 'lwc1': 0x31, 'sc': 0x38, 'swc1': 0x39,
+}
+
+MEMORY_OPS = ('lw', 'sw', 'll', 'sc', 'lwc1', 'swc1')
+
+# COP1 (opcode 0x11): the rs field of the moves and branches, the format
+# and function of the arithmetic
+COP0_MOVES = {'mfc0': 0x00, 'mtc0': 0x04}
+COP1_MOVES = {'mfc1': 0x00, 'cfc1': 0x02, 'mtc1': 0x04, 'ctc1': 0x06}
+COP1_BRANCHES = {'bc1f': 0, 'bc1t': 1}
+COP1_FORMATS = {'s': 0x10, 'd': 0x11, 'w': 0x14}
+COP1_FUNCT = {
+    'add': 0x00, 'sub': 0x01, 'mul': 0x02, 'div': 0x03,
+    'sqrt': 0x04, 'abs': 0x05, 'mov': 0x06, 'neg': 0x07, 'trunc.w': 0x0D,
+    'cvt.s': 0x20, 'cvt.d': 0x21, 'cvt.w': 0x24,
+}
+COP1_CONDITIONS = ['f', 'un', 'eq', 'ueq', 'olt', 'ult', 'ole', 'ule',
+                   'sf', 'ngle', 'seq', 'ngl', 'lt', 'nge', 'le', 'ngt']
+
+
+def register(text):
+    text = text.strip().lstrip('$')
+    if re.match(r'f\d+$', text):
+        return int(text[1:])
+    return int(text) if text.isdigit() else REGISTERS[text]
+
+
+def cop1(fmt, ft, fs, fd, funct):
+    return (0x11 << 26) | (fmt << 21) | (ft << 16) | (fs << 11) | (fd << 6) | funct
+
+
+def parse(lines):
+    """Returns the label addresses and the instruction lines."""
+    labels, items = {}, []
+    for line in lines:
+        line = line.split('#')[0].strip()
+        while ':' in line:
+            label, line = line.split(':', 1)
+            labels[label.strip()] = len(items) * 4
+            line = line.strip()
+        if line:
+            items.append(line)
+    return labels, items
+
+
+def encode(line, pc, labels):
+    parts = line.split(None, 1)
+    op = parts[0]
+    args = [a.strip() for a in parts[1].split(',')] if len(parts) > 1 else []
+
+    def value(text):
+        return labels[text] if text in labels else int(text, 0)
+
+    def rtype(rs, rt, rd, shamt=0):
+        return (rs << 21) | (rt << 16) | (rd << 11) | ((shamt & 31) << 6) | FUNCT[op]
+
+    def itype(rs, rt, imm):
+        return (OPCODE[op] << 26) | (rs << 21) | (rt << 16) | (imm & 0xFFFF)
+
+    if op == 'nop':
+        return 0
+    if op == '.word':
+        return value(args[0]) & 0xFFFFFFFF
+    if op in ('sll', 'srl', 'sra'):
+        return rtype(0, register(args[1]), register(args[0]), value(args[2]))
+    if op in ('sllv', 'srlv', 'srav'):
+        return rtype(register(args[2]), register(args[1]), register(args[0]))
+    if op in ('mult', 'multu', 'div', 'divu'):
+        return rtype(register(args[0]), register(args[1]), 0)
+    if op in FUNCT2:
+        rd, rs, rt = (register(a) for a in args) if op == 'mul' else (0, register(args[0]), register(args[1]))
+        return (0x1C << 26) | (rs << 21) | (rt << 16) | (rd << 11) | FUNCT2[op]
+    if op in ('mfhi', 'mflo'):
+        return rtype(0, 0, register(args[0]))
+    if op in ('mthi', 'mtlo', 'jr'):
+        return rtype(register(args[0]), 0, 0)
+    if op == 'jalr':
+        if len(args) == 2:
+            return rtype(register(args[1]), 0, register(args[0]))
+        return rtype(register(args[0]), 0, 31)
+    if op in ('syscall', 'break', 'sync'):
+        return rtype(0, 0, 0)
+    if op in FUNCT:
+        return rtype(register(args[1]), register(args[2]), register(args[0]))
+    if op == 'eret':
+        return 0x42000018
+    if op in COP0_MOVES:
+        return (0x10 << 26) | (COP0_MOVES[op] << 21) | (register(args[0]) << 16) | (register(args[1]) << 11)
+    if op in COP1_MOVES:
+        return cop1(COP1_MOVES[op], register(args[0]), register(args[1]), 0, 0)
+    if op in COP1_BRANCHES:
+        offset = (value(args[0]) - (pc + 4)) >> 2
+        return (0x11 << 26) | (0x08 << 21) | (COP1_BRANCHES[op] << 16) | (offset & 0xFFFF)
+    if '.' in op:
+        name, fmt = op.rsplit('.', 1)
+        regs = [register(a) for a in args]
+        if name.startswith('c.'):
+            return cop1(COP1_FORMATS[fmt], regs[1], regs[0], 0, 0x30 | COP1_CONDITIONS.index(name[2:]))
+        if len(regs) == 3:
+            return cop1(COP1_FORMATS[fmt], regs[2], regs[1], regs[0], COP1_FUNCT[name])
+        return cop1(COP1_FORMATS[fmt], 0, regs[1], regs[0], COP1_FUNCT[name])
+    if op in ('beq', 'bne'):
+        offset = (value(args[2]) - (pc + 4)) >> 2
+        return itype(register(args[0]), register(args[1]), offset)
+    if op in MEMORY_OPS:
+        match = re.match(r'(.*)\((.*)\)', args[1])
+        offset = value(match.group(1)) if match.group(1) else 0
+        return itype(register(match.group(2)), register(args[0]), offset)
+    if op in ('j', 'jal'):
+        return (OPCODE[op] << 26) | ((value(args[0]) >> 2) & 0x03FFFFFF)
+    if op in OPCODE:
+        return itype(register(args[1]), register(args[0]), value(args[2]))
+    raise ValueError('unknown instruction: ' + line)
+
+
+def assemble(lines):
+    labels, items = parse(lines)
+    return [(encode(line, index * 4, labels), line) for index, line in enumerate(items)]
+
+
+if __name__ == '__main__':
+    with open(sys.argv[1]) as source:
+        words = assemble(source.read().splitlines())
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], 'wb') as output:
+            for word, _ in words:
+                output.write(struct.pack('<I', word))
+    else:
+        for word, line in words:
+            print('0x%08x, // %s' % (word, line))
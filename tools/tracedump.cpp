@@ -0,0 +1,86 @@
+/*
+ *    The MIT License
+ *    
+ *    Copyright (c) 2011, Tamás Szelei
+ *    
+ *    Permission is hereby granted, free of charge, to any person obtaining a copy
+ *    of this software and associated documentation files (the "Software"), to deal
+ *    in the Software without restriction, including without limitation the rights
+ *    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *    copies of the Software, and to permit persons to whom the Software is
+ *    furnished to do so, subject to the following conditions:
+ *    
+ *    The above copyright notice and this permission notice shall be included in
+ *    all copies or substantial portions of the Software.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *    THE SOFTWARE.
+ */
+
+/*
+ * Decodes a trace file written by TraceBuffer into readable disassembly,
+ * oldest instruction first:
+ *
+ *     tracedump <trace file> [last N]
+ */
+
+#include "../src/disasm.h"
+#include "../src/tracebuffer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <trace file> [last N]\n", argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        boost::shared_ptr<tememu::TraceBuffer> trace = tememu::TraceBuffer::open(argv[1]);
+
+        size_t count = trace->size();
+        size_t first = 0;
+
+        if (argc > 2)
+        {
+            size_t last = std::strtoul(argv[2], 0, 10);
+            if (last < count) first = count - last;
+        }
+
+        std::printf("# %llu instructions retired, %lu in the buffer\n", 
+            (unsigned long long)trace->written(), (unsigned long)count);
+
+        for (size_t i = first; i < count; ++i)
+        {
+            tememu::TraceRecord record = trace->record(i);
+            std::string text = tememu::disassemble(record.instr, record.pc);
+
+            if (record.reg != tememu::TraceBuffer::no_register)
+            {
+                std::printf("%08x:  %08x  %-32s # %s = 0x%08x\n", record.pc, record.instr, text.c_str(),
+                    tememu::registerName(record.reg).c_str(), record.value);
+            }
+            else
+            {
+                std::printf("%08x:  %08x  %s\n", record.pc, record.instr, text.c_str());
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s: %s\n", argv[0], e.what());
+        return 1;
+    }
+
+    return 0;
+}